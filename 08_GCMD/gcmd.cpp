@@ -9,7 +9,16 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
+//GCMD_REPLAY builds only the translation layer, against the stub device in stub/. See gcmdreplay.cpp.
+#ifndef GCMD_REPLAY
 #pragma comment(lib, "D3DCompiler.lib")
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dwmapi.lib")
@@ -17,18 +26,27 @@
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "winmm.lib")
+#endif
 
 enum {
 	CMD_NOP,
 	CMD_SET_BARRIER,
 	CMD_SET_RENDER_TARGET,
 	CMD_SET_TEXTURE,
+	CMD_UPDATE_TEXTURE,
 	CMD_SET_VERTEX,
 	CMD_SET_INDEX,
 	CMD_SET_CONSTANT,
 	CMD_SET_SHADER,
 	CMD_CLEAR,
+	CMD_CLEAR_DEPTH,
 	CMD_DRAW_INDEX,
+	CMD_DRAW_INDEXED_INSTANCED,
+	CMD_DRAW_INDIRECT,
+	CMD_SET_COMPUTE_SHADER,
+	CMD_SET_UAV,
+	CMD_DISPATCH,
+	CMD_RELEASE,
 	CMD_QUIT,
 	CMD_MAX,
 };
@@ -46,229 +64,3466 @@ struct vector4 {
 	};
 };
 
-struct cmd {
-	int type;
-	std::string name;
-	struct rect_t {
-		int x, y, w, h;
+//Shared by the thread that builds frames and the render thread. The deque keeps the strings in
+//place, so GetName pointers stay valid while other names are added.
+struct nametable {
+	std::mutex lock;
+	std::unordered_map<std::string, uint32_t> mid;
+	std::deque<std::string> vname;
+};
+
+nametable & GetNameTable()
+{
+	static nametable table;
+	return table;
+}
+
+//Interns the name and returns a dense id. Ids are stable for the process lifetime.
+uint32_t GetNameId(const std::string & name)
+{
+	auto & table = GetNameTable();
+	std::lock_guard<std::mutex> lk(table.lock);
+	auto it = table.mid.find(name);
+	if(it != table.mid.end())
+		return it->second;
+	uint32_t id = uint32_t(table.vname.size());
+	table.mid[name] = id;
+	table.vname.push_back(name);
+	return id;
+}
+
+const char * GetName(uint32_t id)
+{
+	auto & table = GetNameTable();
+	std::lock_guard<std::mutex> lk(table.lock);
+	return id < table.vname.size() ? table.vname[id].c_str() : "(null)";
+}
+
+uint32_t GetNameCount()
+{
+	auto & table = GetNameTable();
+	std::lock_guard<std::mutex> lk(table.lock);
+	return uint32_t(table.vname.size());
+}
+
+//Accepts either a name or an already interned id.
+struct nameid {
+	uint32_t id;
+	nameid(uint32_t id) : id(id) {}
+	nameid(const char *name) : id(GetNameId(name)) {}
+	nameid(const std::string & name) : id(GetNameId(name)) {}
+};
+
+//A command is a cmdheader followed by its POD payload, padded to 8 bytes and appended to a cmdbuffer.
+struct cmdheader {
+	uint16_t type;
+	uint16_t size;
+	uint32_t id;
+};
+
+struct rect_t {
+	int x, y, w, h;
+};
+
+struct set_barrier_t {
+	bool to_present;
+	bool to_rendertarget;
+	bool to_texture;
+};
+
+struct set_render_target_t {
+	int fmt;
+	rect_t rect;
+	bool has_depth; //Binds a D32 depth buffer owned by the render target.
+	bool is_transient; //Contents only live within the frame, memory is shared with other transients.
+};
+
+struct set_texture_t {
+	int fmt;
+	int slot;
+	void *data;
+	size_t size;
+	rect_t rect;
+	bool is_compute; //Filled in by the prepare pass.
+	bool is_placeholder; //Filled in by PlanBarriers, the upload is still on the copy queue.
+};
+
+//Replaces rect of an existing texture. data holds rect.h rows of rect.w texels, pitch bytes apart.
+struct update_texture_t {
+	rect_t rect;
+	void *data;
+	size_t size;
+	size_t pitch;
+	ID3D12Resource *staging; //Filled in by the prepare pass.
+	uint64_t offset;         //Filled in by the prepare pass.
+	uint32_t row_pitch;      //Filled in by the prepare pass.
+};
+
+struct set_vertex_t {
+	void *data;
+	size_t size;
+	size_t stride_size;
+};
+
+struct set_index_t {
+	void *data;
+	size_t size;
+};
+
+struct set_constant_t {
+	int slot;
+	void *data;
+	size_t size;
+	uint64_t gpu_address; //Filled in by the prepare pass.
+	bool is_compute;      //Filled in by the prepare pass.
+};
+
+struct set_shader_t {
+	bool is_update;
+	bool is_prepass;   //Set on the copies made by AddDepthPrepass.
+	uint32_t pipeline; //Filled in by the prepare pass.
+};
+
+struct clear_t {
+	vector4 color;
+};
+
+struct clear_depth_t {
+	float depth;
+};
+
+struct draw_index_t {
+	int start;
+	int count;
+	float depth;     //Sort key depth in [0, 1], nearer first. Used when presentoption::sort_draws is set.
+	bool is_ordered; //Never moved by the sort, and draws are not moved across it.
+};
+
+struct draw_indexed_instanced_t {
+	int index_count;
+	int instance_count;
+	int start_index;
+	int base_vertex;
+	int start_instance;
+	float depth;
+	bool is_ordered;
+};
+
+//The command's name is the argument buffer, an array of D3D12_DRAW_INDEXED_ARGUMENTS.
+struct draw_indirect_t {
+	void *data; //Initial arguments, uploaded when the buffer is created.
+	size_t size;
+	uint64_t offset;
+	int max_count;
+};
+
+struct set_compute_shader_t {
+	bool is_update;
+};
+
+//A structured buffer when size is set, an R8G8B8A8 texture of rect otherwise.
+struct set_uav_t {
+	int slot;
+	rect_t rect;
+	size_t size;
+	size_t stride_size;
+};
+
+struct dispatch_t {
+	int x, y, z;
+};
+
+struct release_t {
+	int reserved;
+};
+
+template<typename T>
+T & GetPayload(const cmdheader *c)
+{
+	return *(T *)(c + 1);
+}
+
+//Linear allocator for the data referenced by commands. Blocks are kept across reset(), and
+//never move, so payload pointers stay valid until the arena is reset.
+struct payloadarena {
+	enum {
+		BlockSize = 1024 * 1024,
+	};
+	std::vector<std::vector<uint8_t>> vblock;
+	size_t block = 0;
+	size_t used = 0;
+	size_t total = 0;
+
+	void * alloc(const void *src, size_t size)
+	{
+		if(src == nullptr || size == 0)
+			return nullptr;
+		size_t aligned = (size + 15) & ~size_t(15);
+		if(vblock.empty() || used + aligned > vblock[block].size()) {
+			if(!vblock.empty())
+				block++;
+			while(block < vblock.size() && vblock[block].size() < aligned)
+				block++;
+			if(block >= vblock.size()) {
+				vblock.emplace_back(std::max<size_t>(BlockSize, aligned));
+				block = vblock.size() - 1;
+			}
+			used = 0;
+		}
+		void *dest = &vblock[block][used];
+		memcpy(dest, src, size);
+		used += aligned;
+		total += aligned;
+		return dest;
+	}
+
+	void reset()
+	{
+		block = 0;
+		used = 0;
+		total = 0;
+	}
+};
+
+//Linear command stream. clear() keeps the storage, so recording a frame of the same size never allocates.
+//Payload data is copied into the arena at record time, so the caller's buffers may be reused immediately.
+struct cmdbuffer {
+	std::vector<uint8_t> data;
+	size_t used = 0;
+	size_t count = 0;
+	payloadarena arena;
+
+	struct iterator {
+		cmdheader *c;
+		cmdheader * operator*() const { return c; }
+		iterator & operator++() { c = (cmdheader *)((uint8_t *)c + c->size); return *this; }
+		bool operator!=(const iterator & x) const { return c != x.c; }
+	};
+
+	cmdbuffer(size_t reserve = 64 * 1024) : data(reserve) {}
+
+	template<typename T>
+	T & push(int type, uint32_t id)
+	{
+		size_t size = (sizeof(cmdheader) + sizeof(T) + 7) & ~size_t(7);
+		if(used + size > data.size())
+			data.resize((used + size) * 2);
+		auto c = (cmdheader *)&data[used];
+		c->type = uint16_t(type);
+		c->size = uint16_t(size);
+		c->id = id;
+		memset(c + 1, 0, size - sizeof(cmdheader));
+		used += size;
+		count++;
+		return GetPayload<T>(c);
+	}
+
+	//Copies a command as it is, payload pointers included.
+	cmdheader * append(const cmdheader *src)
+	{
+		if(used + src->size > data.size())
+			data.resize((used + src->size) * 2);
+		auto c = (cmdheader *)&data[used];
+		memcpy(c, src, src->size);
+		used += src->size;
+		count++;
+		return c;
+	}
+
+	//Swaps the commands only. The arenas stay, so payload pointers still point into this buffer's arena.
+	void swap_stream(cmdbuffer & x)
+	{
+		std::swap(data, x.data);
+		std::swap(used, x.used);
+		std::swap(count, x.count);
+	}
+
+	iterator begin() { return {(cmdheader *)data.data()}; }
+	iterator end() { return {(cmdheader *)(data.data() + used)}; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	void clear()
+	{
+		used = 0;
+		count = 0;
+		arena.reset();
+	}
+};
+
+const char * GetCmdName(int type)
+{
+	static const char *vname[] = {
+		"CMD_NOP",
+		"CMD_SET_BARRIER",
+		"CMD_SET_RENDER_TARGET",
+		"CMD_SET_TEXTURE",
+		"CMD_UPDATE_TEXTURE",
+		"CMD_SET_VERTEX",
+		"CMD_SET_INDEX",
+		"CMD_SET_CONSTANT",
+		"CMD_SET_SHADER",
+		"CMD_CLEAR",
+		"CMD_CLEAR_DEPTH",
+		"CMD_DRAW_INDEX",
+		"CMD_DRAW_INDEXED_INSTANCED",
+		"CMD_DRAW_INDIRECT",
+		"CMD_SET_COMPUTE_SHADER",
+		"CMD_SET_UAV",
+		"CMD_DISPATCH",
+		"CMD_RELEASE",
+		"CMD_QUIT",
+	};
+	static_assert(_countof(vname) == CMD_MAX, "vname must cover every command type");
+	return type >= 0 && type < CMD_MAX ? vname[type] : "CMD_UNKNOWN";
+}
+
+//Returns the payload field pointing at data outside the stream, or nullptr when the command has none.
+void ** GetCmdData(const cmdheader *c, size_t & size)
+{
+	size = 0;
+	switch(c->type) {
+	case CMD_SET_TEXTURE: {
+		auto & x = GetPayload<set_texture_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	case CMD_UPDATE_TEXTURE: {
+		auto & x = GetPayload<update_texture_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	case CMD_SET_VERTEX: {
+		auto & x = GetPayload<set_vertex_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	case CMD_SET_INDEX: {
+		auto & x = GetPayload<set_index_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	case CMD_SET_CONSTANT: {
+		auto & x = GetPayload<set_constant_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	case CMD_DRAW_INDIRECT: {
+		auto & x = GetPayload<draw_indirect_t>(c);
+		size = x.size;
+		return &x.data;
+	}
+	}
+	return nullptr;
+}
+
+void PrintCmd(const cmdheader *c)
+{
+	printf("cmd:name=%s:\t\t\t", GetName(c->id));
+	switch(c->type) {
+	case CMD_CLEAR: {
+		auto & clear = GetPayload<clear_t>(c);
+		printf("CMD_CLEAR :%f %f %f %f\n", clear.color.x, clear.color.y, clear.color.z, clear.color.w);
+		break;
+	}
+	case CMD_CLEAR_DEPTH: {
+		auto & clear_depth = GetPayload<clear_depth_t>(c);
+		printf("CMD_CLEAR_DEPTH :%f\n", clear_depth.depth);
+		break;
+	}
+	case CMD_SET_BARRIER: {
+		auto & set_barrier = GetPayload<set_barrier_t>(c);
+		printf("CMD_SET_BARRIER :");
+		printf("%d %d %d\n", set_barrier.to_present, set_barrier.to_rendertarget, set_barrier.to_texture);
+		break;
+	}
+	case CMD_SET_RENDER_TARGET: {
+		auto & set_render_target = GetPayload<set_render_target_t>(c);
+		printf("CMD_SET_RENDER_TARGET :");
+		printf("rect.x=%d rect.x=%d rect.x=%d rect.x=%d : fmt=%d has_depth=%d is_transient=%d\n",
+			set_render_target.rect.x, set_render_target.rect.y, set_render_target.rect.w, set_render_target.rect.h, set_render_target.fmt,
+			set_render_target.has_depth, set_render_target.is_transient);
+		break;
+	}
+	case CMD_SET_TEXTURE: {
+		auto & set_texture = GetPayload<set_texture_t>(c);
+		printf("CMD_SET_TEXTURE :");
+		printf("%d %d %d %d : slot=%d, fmt=%d, data=%p, size=%zu, is_placeholder=%d\n",
+			set_texture.rect.x, set_texture.rect.y, set_texture.rect.w, set_texture.rect.h, set_texture.slot, set_texture.fmt, set_texture.data, set_texture.size,
+			set_texture.is_placeholder);
+		break;
+	}
+	case CMD_UPDATE_TEXTURE: {
+		auto & update_texture = GetPayload<update_texture_t>(c);
+		printf("CMD_UPDATE_TEXTURE :");
+		printf("%d %d %d %d : data=%p, size=%zu, pitch=%zu\n",
+			update_texture.rect.x, update_texture.rect.y, update_texture.rect.w, update_texture.rect.h,
+			update_texture.data, update_texture.size, update_texture.pitch);
+		break;
+	}
+	case CMD_SET_VERTEX: {
+		auto & set_vertex = GetPayload<set_vertex_t>(c);
+		printf("CMD_SET_VERTEX :");
+		printf("data=%p, size=%zu\n", set_vertex.data, set_vertex.size);
+		break;
+	}
+	case CMD_SET_INDEX: {
+		auto & set_index = GetPayload<set_index_t>(c);
+		printf("CMD_SET_INDEX :");
+		printf("data=%p, size=%zu\n", set_index.data, set_index.size);
+		break;
+	}
+	case CMD_SET_CONSTANT: {
+		auto & set_constant = GetPayload<set_constant_t>(c);
+		printf("CMD_SET_CONSTANT :");
+		printf("slot=%d, data=%p, size=%zu\n", set_constant.slot, set_constant.data, set_constant.size);
+		break;
+	}
+	case CMD_SET_SHADER: {
+		auto & set_shader = GetPayload<set_shader_t>(c);
+		printf("CMD_SET_SHADER :");
+		printf("is_update=%d is_prepass=%d\n", set_shader.is_update, set_shader.is_prepass);
+		break;
+	}
+	case CMD_DRAW_INDEX: {
+		auto & draw_index = GetPayload<draw_index_t>(c);
+		printf("CMD_DRAW_INDEX :");
+		printf("start=%d, count=%d, depth=%f, is_ordered=%d\n", draw_index.start, draw_index.count, draw_index.depth, draw_index.is_ordered);
+		break;
+	}
+	case CMD_DRAW_INDEXED_INSTANCED: {
+		auto & draw = GetPayload<draw_indexed_instanced_t>(c);
+		printf("CMD_DRAW_INDEXED_INSTANCED :");
+		printf("index_count=%d, instance_count=%d, start_index=%d, base_vertex=%d, start_instance=%d, depth=%f, is_ordered=%d\n",
+			draw.index_count, draw.instance_count, draw.start_index, draw.base_vertex, draw.start_instance, draw.depth, draw.is_ordered);
+		break;
+	}
+	case CMD_DRAW_INDIRECT: {
+		auto & draw = GetPayload<draw_indirect_t>(c);
+		printf("CMD_DRAW_INDIRECT :");
+		printf("data=%p, size=%zu, offset=%llu, max_count=%d\n", draw.data, draw.size, (unsigned long long)draw.offset, draw.max_count);
+		break;
+	}
+	case CMD_SET_COMPUTE_SHADER: {
+		auto & set_compute_shader = GetPayload<set_compute_shader_t>(c);
+		printf("CMD_SET_COMPUTE_SHADER :");
+		printf("is_update=%d\n", set_compute_shader.is_update);
+		break;
+	}
+	case CMD_SET_UAV: {
+		auto & set_uav = GetPayload<set_uav_t>(c);
+		printf("CMD_SET_UAV :");
+		printf("%d %d %d %d : slot=%d, size=%zu, stride_size=%zu\n",
+			set_uav.rect.x, set_uav.rect.y, set_uav.rect.w, set_uav.rect.h, set_uav.slot, set_uav.size, set_uav.stride_size);
+		break;
+	}
+	case CMD_DISPATCH: {
+		auto & dispatch = GetPayload<dispatch_t>(c);
+		printf("CMD_DISPATCH :");
+		printf("x=%d, y=%d, z=%d\n", dispatch.x, dispatch.y, dispatch.z);
+		break;
+	}
+	case CMD_RELEASE:
+		printf("CMD_RELEASE\n");
+		break;
+	default:
+		printf("\n");
+		break;
+	}
+}
+
+struct framestats {
+	uint64_t cmd_count = 0;
+	uint64_t removed_count = 0;
+	uint64_t payload_bytes = 0;
+	uint64_t barrier_count = 0;
+	uint64_t barrier_batches = 0;
+	uint64_t segment_count = 0;
+	uint64_t constant_bytes = 0;
+	uint64_t update_bytes = 0;
+	uint64_t heap_reserved = 0;
+	uint64_t heap_used = 0;
+	uint64_t scratch_hit = 0;
+	uint64_t scratch_miss = 0;
+	uint64_t scratch_bytes = 0;
+	uint64_t released_count = 0;
+	uint64_t packet_count = 0;
+	uint64_t prepass_count = 0;
+	uint64_t reused_count = 0; //Segments whose command list from an earlier frame ran again.
+	uint64_t transient_bytes = 0; //Transient render targets of the frame, without aliasing.
+	uint64_t transient_peak = 0;  //The same targets packed into the transient heap.
+	uint64_t placeholder_count = 0; //Texture bindings given the placeholder while their upload is in flight.
+	uint64_t copy_wait_count = 0;   //1 when the frame waits on the copy queue before it runs.
+	uint64_t inflight_count = 0;    //Earlier frames still on the GPU when this one starts recording.
+	double wait_us = 0.0;           //CPU time blocked on the swap chain latency object and on fences.
+	double gpu_us = 0.0;            //Submit to observed completion of the last frame of this back buffer.
+	double translate_us = 0.0;
+	uint64_t vtype_count[CMD_MAX] = {}; //Filled in when presentoption::profile is set.
+	double vtype_ns[CMD_MAX] = {};
+};
+
+//Options read by PresentGraphics every frame.
+struct presentoption {
+	UINT thread_count = 1;
+	uint64_t scratch_trim_frames = 120; //Pooled upload buffers unused for this many frames are released.
+	uint64_t evict_frames = 0;          //Resources unused for this many frames are released, 0 keeps them.
+	UINT compile_threads = 2;           //Read once when the device is created.
+	bool profile = false;               //Times every command into framestats::vtype_ns.
+	bool sort_draws = false;            //Reorders the draws of each render target by pipeline, texture, vertex and depth.
+	bool depth_prepass = false;         //Draws the opaque draws depth only first on render targets with depth.
+	UINT queue_depth = 0;               //Frames the builder may run ahead of a render thread, 0 translates in place.
+	bool reuse_segments = false;        //Runs a segment's list again when it would record the same commands.
+	bool bindless = false;              //Read once when the device is created. Textures become root constant indices.
+	bool copy_queue = false;            //Read once when the device is created. Textures upload on a copy queue.
+	UINT max_frames = 0;                //Frames queued ahead of the GPU, 0 allows one per back buffer.
+};
+
+presentoption & GetPresentOption()
+{
+	static presentoption option;
+	return option;
+}
+
+//Persistent worker threads. run() hands out the indices [0, count) to the workers and the calling
+//thread, and returns once every index has been processed.
+struct workerpool {
+	std::vector<std::thread> vthread;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::function<void(size_t)> job;
+	std::atomic<size_t> next {0};
+	size_t count = 0;
+	size_t finished = 0;
+	uint64_t generation = 0;
+	bool quit = false;
+
+	void start(size_t thread_count)
+	{
+		stop();
+		quit = false;
+		for(size_t i = 1 ; i < thread_count; i++)
+			vthread.emplace_back([this] { loop(); });
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			quit = true;
+		}
+		wake.notify_all();
+		for(auto & x : vthread)
+			x.join();
+		vthread.clear();
+	}
+
+	void work()
+	{
+		for(size_t i = next++; i < count; i = next++)
+			job(i);
+	}
+
+	void loop()
+	{
+		uint64_t seen = 0;
+		for(;;) {
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				wake.wait(lk, [&] { return quit || generation != seen; });
+				if(quit)
+					return;
+				seen = generation;
+			}
+			work();
+			std::lock_guard<std::mutex> lk(lock);
+			if(++finished == vthread.size())
+				done.notify_one();
+		}
+	}
+
+	void run(size_t n, std::function<void(size_t)> fn)
+	{
+		if(vthread.empty() || n <= 1) {
+			for(size_t i = 0 ; i < n; i++)
+				fn(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			job = fn;
+			count = n;
+			next = 0;
+			finished = 0;
+			generation++;
+		}
+		wake.notify_all();
+		work();
+		std::unique_lock<std::mutex> lk(lock);
+		done.wait(lk, [&] { return finished == vthread.size(); });
+	}
+};
+
+double GetMicroSeconds()
+{
+	static LARGE_INTEGER freq = {};
+	LARGE_INTEGER count = {};
+	if(freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return double(count.QuadPart) * 1000000.0 / double(freq.QuadPart);
+}
+
+//Single producer, single consumer handoff of finished frame streams to a render thread, so building
+//the next frame overlaps translating the last one. Each slot owns a whole cmdbuffer, payloads included.
+//publish() waits while every slot is queued, which bounds how far the builder runs ahead.
+struct framequeue {
+	std::vector<cmdbuffer> vslot;
+	std::atomic<uint64_t> head {0}; //Frames published, written by the producer only.
+	std::atomic<uint64_t> tail {0}; //Frames consumed, written by the render thread only.
+	std::atomic<bool> quit {false};
+	std::mutex lock;                //Only for sleeping, the handoff itself does not lock.
+	std::condition_variable wake;
+	std::thread thread;
+	std::function<void(cmdbuffer &)> consume;
+	uint64_t wait_count = 0;        //Frames publish() had to wait for, and how long.
+	double wait_us = 0.0;
+
+	void start(size_t depth, std::function<void(cmdbuffer &)> fn)
+	{
+		stop();
+		vslot.clear();
+		vslot.resize(std::max<size_t>(depth, 1));
+		head = 0;
+		tail = 0;
+		quit = false;
+		consume = fn;
+		thread = std::thread([this] { loop(); });
+	}
+
+	//Translates the frames already published, then joins the render thread.
+	void stop()
+	{
+		if(!thread.joinable())
+			return;
+		quit = true;
+		wake.notify_all();
+		thread.join();
+	}
+
+	~framequeue()
+	{
+		stop();
+	}
+
+	//Spins briefly, then sleeps. The timeout covers a notify that lands between the check and the wait.
+	template<typename F>
+	void wait(F ready)
+	{
+		for(int i = 0 ; i < 64; i++) {
+			if(ready())
+				return;
+			std::this_thread::yield();
+		}
+		std::unique_lock<std::mutex> lk(lock);
+		while(!ready())
+			wake.wait_for(lk, std::chrono::milliseconds(1));
+	}
+
+	//Hands vcmd to the render thread and gives back the empty stream of a translated frame.
+	void publish(cmdbuffer & vcmd)
+	{
+		auto h = head.load(std::memory_order_relaxed);
+		auto is_free = [&] { return h - tail.load(std::memory_order_acquire) < vslot.size(); };
+		if(!is_free()) {
+			auto start = GetMicroSeconds();
+			wait(is_free);
+			wait_us += GetMicroSeconds() - start;
+			wait_count++;
+		}
+		std::swap(vslot[h % vslot.size()], vcmd);
+		head.store(h + 1, std::memory_order_release);
+		wake.notify_all();
+	}
+
+	void loop()
+	{
+		for(;;) {
+			auto t = tail.load(std::memory_order_relaxed);
+			wait([&] { return head.load(std::memory_order_acquire) != t || quit; });
+			if(head.load(std::memory_order_acquire) == t)
+				return;
+			consume(vslot[t % vslot.size()]);
+			tail.store(t + 1, std::memory_order_release);
+			wake.notify_all();
+		}
+	}
+};
+
+//Power of two blocks carved out of one heap. Only offsets and sizes are tracked, so it can be
+//exercised on the CPU without a device.
+struct buddyallocator {
+	static const uint64_t InvalidOffset = ~0ull;
+	uint64_t minblock = 0;
+	uint64_t size = 0;
+	uint64_t used = 0;
+	std::vector<std::vector<uint64_t>> vfree; //Free offsets per order, order 0 is minblock.
+
+	void init(uint64_t total, uint64_t minsize)
+	{
+		minblock = minsize;
+		size = minsize;
+		used = 0;
+		uint32_t order = 0;
+		while(size < total) {
+			size *= 2;
+			order++;
+		}
+		vfree.assign(order + 1, {});
+		vfree[order].push_back(0);
+	}
+
+	uint32_t GetOrder(uint64_t n) const
+	{
+		uint32_t order = 0;
+		for(uint64_t block = minblock; block < n; block *= 2)
+			order++;
+		return order;
+	}
+
+	//Blocks are aligned to their own size, so the alignment only raises the order.
+	uint64_t alloc(uint64_t n, uint64_t align)
+	{
+		auto order = GetOrder(std::max(n, align));
+		auto k = order;
+		while(k < vfree.size() && vfree[k].empty())
+			k++;
+		if(k >= vfree.size())
+			return InvalidOffset;
+		auto offset = vfree[k].back();
+		vfree[k].pop_back();
+		while(k > order) {
+			k--;
+			vfree[k].push_back(offset + (minblock << k));
+		}
+		used += minblock << order;
+		return offset;
+	}
+
+	void free(uint64_t offset, uint64_t n, uint64_t align)
+	{
+		auto order = GetOrder(std::max(n, align));
+		used -= minblock << order;
+		while(order + 1 < vfree.size()) {
+			auto buddy = offset ^ (minblock << order);
+			auto & v = vfree[order];
+			auto it = std::find(v.begin(), v.end(), buddy);
+			if(it == v.end())
+				break;
+			*it = v.back();
+			v.pop_back();
+			offset = std::min(offset, buddy);
+			order++;
+		}
+		vfree[order].push_back(offset);
+	}
+
+	uint64_t GetLargestFree() const
+	{
+		for(size_t k = vfree.size(); k-- > 0; )
+			if(!vfree[k].empty())
+				return minblock << k;
+		return 0;
+	}
+
+	//0 when the free space is one block, close to 1 when it is scattered into small pieces.
+	double GetFragmentation() const
+	{
+		auto free_size = size - used;
+		return free_size ? 1.0 - double(GetLargestFree()) / double(free_size) : 0.0;
+	}
+};
+
+//Places resources into large ID3D12Heap blocks instead of one committed allocation each.
+//Released ranges go back to the buddy free lists and are reused by later resources.
+struct heapmanager {
+	static const uint64_t BlockSize = 64 * 1024 * 1024;
+	static const uint64_t MinBlock = 64 * 1024; //D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+	enum {
+		HEAP_UPLOAD,
+		HEAP_BUFFER,
+		HEAP_TEXTURE,
+		HEAP_RENDER_TARGET,
+		HEAP_KIND_MAX,
+	};
+	struct heapblock {
+		ID3D12Heap *heap;
+		buddyallocator alloc;
+	};
+	struct allocation {
+		uint32_t kind;
+		uint32_t block;
+		uint64_t offset;
+		uint64_t size;
+		uint64_t align;
+	};
+	std::vector<heapblock> vblock[HEAP_KIND_MAX];
+	std::unordered_map<ID3D12Resource *, allocation> mallocation;
+
+	static uint32_t GetKind(const D3D12_HEAP_PROPERTIES & hprop, const D3D12_RESOURCE_DESC & desc)
+	{
+		if(hprop.Type == D3D12_HEAP_TYPE_UPLOAD)
+			return HEAP_UPLOAD;
+		if(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			return HEAP_BUFFER;
+		if(desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+			return HEAP_RENDER_TARGET;
+		return HEAP_TEXTURE;
+	}
+
+	//Returns nullptr when the resource does not fit a block, the caller then falls back to a committed resource.
+	ID3D12Resource * create(ID3D12Device *dev, const D3D12_HEAP_PROPERTIES & hprop, const D3D12_RESOURCE_DESC & desc,
+		D3D12_RESOURCE_STATES state)
+	{
+		static const D3D12_HEAP_FLAGS vflags[HEAP_KIND_MAX] = {
+			D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+			D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+			D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+			D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+		};
+		auto kind = GetKind(hprop, desc);
+		auto info = dev->GetResourceAllocationInfo(0, 1, &desc);
+		if(info.SizeInBytes > BlockSize || info.Alignment > BlockSize)
+			return nullptr;
+		auto & v = vblock[kind];
+		for(uint32_t i = 0 ; ; i++) {
+			if(i == v.size()) {
+				D3D12_HEAP_DESC heap_desc = {BlockSize, hprop, 0, vflags[kind]};
+				ID3D12Heap *heap = nullptr;
+				dev->CreateHeap(&heap_desc, IID_PPV_ARGS(&heap));
+				if(heap == nullptr) {
+					printf("%s : ERR CreateHeap kind=%d\n", __FUNCTION__, kind);
+					return nullptr;
+				}
+				v.push_back({heap, {}});
+				v.back().alloc.init(BlockSize, MinBlock);
+			}
+			auto offset = v[i].alloc.alloc(info.SizeInBytes, info.Alignment);
+			if(offset == buddyallocator::InvalidOffset)
+				continue;
+			ID3D12Resource *res = nullptr;
+			dev->CreatePlacedResource(v[i].heap, offset, &desc, state, nullptr, IID_PPV_ARGS(&res));
+			if(res == nullptr) {
+				v[i].alloc.free(offset, info.SizeInBytes, info.Alignment);
+				return nullptr;
+			}
+			mallocation[res] = {kind, i, offset, info.SizeInBytes, info.Alignment};
+			return res;
+		}
+	}
+
+	//Returns the range of a placed resource to its heap. The GPU must be done with it.
+	void release(ID3D12Resource *res)
+	{
+		auto it = mallocation.find(res);
+		if(it == mallocation.end())
+			return;
+		auto & a = it->second;
+		vblock[a.kind][a.block].alloc.free(a.offset, a.size, a.align);
+		mallocation.erase(it);
+	}
+
+	void GetUsage(uint64_t & reserved, uint64_t & used) const
+	{
+		reserved = 0;
+		used = 0;
+		for(auto & v : vblock) {
+			for(auto & x : v) {
+				reserved += x.alloc.size;
+				used += x.alloc.used;
+			}
+		}
+	}
+
+	void report() const
+	{
+		static const char *vname[HEAP_KIND_MAX] = {"upload", "buffer", "texture", "rendertarget"};
+		for(uint32_t kind = 0 ; kind < HEAP_KIND_MAX; kind++) {
+			for(size_t i = 0 ; i < vblock[kind].size(); i++) {
+				auto & alloc = vblock[kind][i].alloc;
+				printf("%s : heap=%s[%zu] used=%llu/%llu largest_free=%llu fragmentation=%f\n", __FUNCTION__, vname[kind], i,
+					(unsigned long long)alloc.used, (unsigned long long)alloc.size, (unsigned long long)alloc.GetLargestFree(), alloc.GetFragmentation());
+			}
+		}
+	}
+
+	void clear()
+	{
+		for(auto & v : vblock) {
+			for(auto & x : v)
+				x.heap->Release();
+			v.clear();
+		}
+		mallocation.clear();
+	}
+};
+
+heapmanager & GetHeapManager()
+{
+	static heapmanager manager;
+	return manager;
+}
+
+//Releases a resource made by CreateResource and gives its heap range back.
+void ReleaseResource(ID3D12Resource *res)
+{
+	if(res == nullptr)
+		return;
+	GetHeapManager().release(res);
+	res->Release();
+}
+
+ID3D12Resource * CreateResource(const char *name, ID3D12Device *dev, int w, int h, DXGI_FORMAT fmt,
+	D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES state, BOOL is_upload = FALSE, void *data = 0, size_t size = 0)
+{
+	ID3D12Resource *res = nullptr;
+	D3D12_RESOURCE_DESC desc = {
+		D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, UINT64(w), UINT(h), 1, 1, fmt,
+		{1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, flags
+	};
+	D3D12_HEAP_PROPERTIES hprop = {
+		D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
+	};
+
+	//DXGI_FORMAT_UNKNOWN makes a buffer of w bytes.
+	if (is_upload || fmt == DXGI_FORMAT_UNKNOWN) {
+		if (is_upload)
+			hprop.Type = D3D12_HEAP_TYPE_UPLOAD;
+		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		desc.Format = DXGI_FORMAT_UNKNOWN;
+		desc.MipLevels = 1;
+	}
+	HRESULT hr = 0;
+	res = GetHeapManager().create(dev, hprop, desc, state);
+	if(res == nullptr)
+		hr = dev->CreateCommittedResource(
+			&hprop, D3D12_HEAP_FLAG_NONE, &desc, state, nullptr, IID_PPV_ARGS(&res));
+	if (hr)
+		printf("%s : ERR name=%s: w=%d, h=%d, flags=%08X, hr=%08X\n", __FUNCTION__, name, w, h, flags, (unsigned)hr);
+	else
+		printf("%s : INFO name=%s: w=%d, h=%d, flags=%08X, hr=%08X\n", __FUNCTION__, name, w, h, flags, (unsigned)hr);
+	if (res && is_upload && data) {
+		UINT8 *dest = nullptr;
+		res->Map(0, NULL, reinterpret_cast<void **>(&dest));
+		if (dest) {
+			printf("%s : INFO UPLOAD name=%s: w=%d, h=%d, data=%p, size=%zu\n",
+				__FUNCTION__, name, w, h, data, size);
+			memcpy(dest, data, size);
+			res->Unmap(0, NULL);
+		} else {
+			printf("%s : cant map\n", __FUNCTION__);
+		}
+	}
+	return res;
+}
+
+//Upload buffers bucketed by power of two size. A frame takes buffers out and gives them back once
+//its fence has completed, and buffers left idle for too long are released.
+struct scratchpool {
+	static const uint64_t MinBucket = 64 * 1024;
+	struct entry {
+		ID3D12Resource *res;
+		uint64_t last_used;
+	};
+	std::map<uint64_t, std::vector<entry>> mbucket;
+	uint64_t hit_count = 0;
+	uint64_t miss_count = 0;
+	uint64_t trim_count = 0;
+	uint64_t resident_bytes = 0;
+
+	static uint64_t GetBucket(uint64_t size)
+	{
+		uint64_t bucket = MinBucket;
+		while(bucket < size)
+			bucket *= 2;
+		return bucket;
+	}
+
+	ID3D12Resource * acquire(ID3D12Device *dev, const void *data, size_t size)
+	{
+		auto bucket = GetBucket(size);
+		auto & v = mbucket[bucket];
+		ID3D12Resource *res = nullptr;
+		if(!v.empty()) {
+			res = v.back().res;
+			v.pop_back();
+			hit_count++;
+		} else {
+			res = CreateResource("scratch", dev, int(bucket), 1, DXGI_FORMAT_UNKNOWN,
+				D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, TRUE);
+			if(res == nullptr)
+				return nullptr;
+			resident_bytes += bucket;
+			miss_count++;
+		}
+		UINT8 *dest = nullptr;
+		D3D12_RANGE range = {0, 0};
+		res->Map(0, &range, reinterpret_cast<void **>(&dest));
+		if (dest) {
+			memcpy(dest, data, size);
+			res->Unmap(0, NULL);
+		} else {
+			printf("%s : cant map\n", __FUNCTION__);
+		}
+		return res;
+	}
+
+	void recycle(ID3D12Resource *res, uint64_t frame)
+	{
+		mbucket[res->GetDesc().Width].push_back({res, frame});
+	}
+
+	void trim(uint64_t frame, uint64_t idle_frames)
+	{
+		for(auto & x : mbucket) {
+			auto & v = x.second;
+			for(size_t i = 0 ; i < v.size(); ) {
+				if(frame - v[i].last_used <= idle_frames) {
+					i++;
+					continue;
+				}
+				resident_bytes -= x.first;
+				trim_count++;
+				ReleaseResource(v[i].res);
+				v[i] = v.back();
+				v.pop_back();
+			}
+		}
+	}
+
+	void clear()
+	{
+		trim(~0ull, 0);
+		mbucket.clear();
+	}
+};
+
+D3D12_RESOURCE_BARRIER GetBarrier(ID3D12Resource *res, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Transition.pResource = res;
+	barrier.Transition.StateBefore = before;
+	barrier.Transition.StateAfter = after;
+	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	return barrier;
+}
+
+D3D12_SHADER_BYTECODE CreateShaderFromFile(
+	std::string fstr, std::string entry, std::string profile, std::vector<uint8_t> &shader_code,
+	const D3D_SHADER_MACRO *defines = nullptr)
+{
+	ID3DBlob *blob = nullptr;
+	ID3DBlob *blob_err = nullptr;
+
+	std::vector<WCHAR> wfname;
+	UINT flags = 0;
+	for (size_t i = 0; i < fstr.length(); i++)
+		wfname.push_back(fstr[i]);
+	wfname.push_back(0);
+	D3DCompileFromFile(&wfname[0], defines, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+		entry.c_str(), profile.c_str(), flags, 0, &blob, &blob_err);
+	if (blob_err) {
+		printf("%s:\n%s\n", __FUNCTION__, (char *)blob_err->GetBufferPointer());
+		blob_err->Release();
+	}
+	if (!blob && !blob_err)
+		printf("File Not found : %s\n", fstr.c_str());
+	if (!blob)
+		return {nullptr, 0};
+	shader_code.resize(blob->GetBufferSize());
+	memcpy(shader_code.data(), blob->GetBufferPointer(), blob->GetBufferSize());
+	if (blob)
+		blob->Release();
+	return {shader_code.data(), shader_code.size()};
+}
+
+enum {
+	PIPELINE_COLOR,
+	PIPELINE_DEPTH,   //Depth tested and written, for render targets with a depth buffer.
+	PIPELINE_PREPASS, //Depth only, no pixel shader.
+	PIPELINE_COMPUTE,
+};
+
+//Bindless shaders index one descriptor array, which needs shader model 5.1.
+ID3D12PipelineState * CreateGraphicsPipeline(ID3D12Device *dev, ID3D12RootSignature *rootsig, const char *name, int kind,
+	bool is_bindless)
+{
+	const D3D_SHADER_MACRO bindless_define[] = {{"GCMD_BINDLESS", "1"}, {nullptr, nullptr}};
+	auto defines = is_bindless ? bindless_define : nullptr;
+	std::vector<uint8_t> vs;
+	std::vector<uint8_t> ps;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC gpstate_desc = {};
+	D3D12_INPUT_ELEMENT_DESC iedesc = {
+		"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
+	};
+	gpstate_desc.InputLayout.pInputElementDescs = &iedesc;
+	gpstate_desc.InputLayout.NumElements = 1;
+	for(auto & bs : gpstate_desc.BlendState.RenderTarget) {
+		bs.BlendEnable = FALSE;
+		bs.LogicOpEnable = FALSE;
+		bs.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+		bs.DestBlend = D3D12_BLEND_INV_DEST_ALPHA;
+		bs.BlendOp = D3D12_BLEND_OP_ADD;
+		bs.SrcBlendAlpha = D3D12_BLEND_ONE;
+		bs.DestBlendAlpha = D3D12_BLEND_ZERO;
+		bs.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+		bs.LogicOp = D3D12_LOGIC_OP_XOR;
+		bs.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+	}
+	gpstate_desc.NumRenderTargets = _countof(gpstate_desc.BlendState.RenderTarget);
+	gpstate_desc.pRootSignature = rootsig;
+	gpstate_desc.VS = CreateShaderFromFile(name, "VSMain", is_bindless ? "vs_5_1" : "vs_5_0", vs, defines);
+	if(kind != PIPELINE_PREPASS)
+		gpstate_desc.PS = CreateShaderFromFile(name, "PSMain", is_bindless ? "ps_5_1" : "ps_5_0", ps, defines);
+	gpstate_desc.SampleDesc.Count = 1;
+	gpstate_desc.SampleMask = UINT_MAX;
+	gpstate_desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+	gpstate_desc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+	gpstate_desc.RasterizerState.DepthClipEnable = TRUE;
+	gpstate_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+
+	for(auto & fmt : gpstate_desc.RTVFormats)
+		fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
+	if(kind == PIPELINE_DEPTH || kind == PIPELINE_PREPASS) {
+		gpstate_desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+		gpstate_desc.DepthStencilState.DepthEnable = TRUE;
+		gpstate_desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+		gpstate_desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+	}
+	if(kind == PIPELINE_PREPASS) {
+		for(auto & bs : gpstate_desc.BlendState.RenderTarget)
+			bs.RenderTargetWriteMask = 0;
+	}
+
+	ID3D12PipelineState *pstate = nullptr;
+	if(!vs.empty() && (!ps.empty() || kind == PIPELINE_PREPASS)) {
+		auto status = dev->CreateGraphicsPipelineState(&gpstate_desc, IID_PPV_ARGS(&pstate));
+		if(pstate == nullptr)
+			printf("Error CreateGraphicsPipelineState : %s : status=%08X\n", name, (unsigned)status);
+	} else {
+		printf("Compile Error %s\n", name);
+	}
+	return pstate;
+}
+
+ID3D12PipelineState * CreateComputePipeline(ID3D12Device *dev, ID3D12RootSignature *rootsig, const char *name)
+{
+	std::vector<uint8_t> cs;
+	D3D12_COMPUTE_PIPELINE_STATE_DESC cpstate_desc = {};
+	cpstate_desc.pRootSignature = rootsig;
+	cpstate_desc.CS = CreateShaderFromFile(name, "CSMain", "cs_5_0", cs);
+
+	ID3D12PipelineState *pstate = nullptr;
+	if(!cs.empty()) {
+		auto status = dev->CreateComputePipelineState(&cpstate_desc, IID_PPV_ARGS(&pstate));
+		if(pstate == nullptr)
+			printf("Error CreateComputePipelineState : %s : status=%08X\n", name, (unsigned)status);
+	} else {
+		printf("Compile Error %s\n", name);
+	}
+	return pstate;
+}
+
+//Compiles shaders and creates their pipelines off the render thread. PresentGraphics picks up the
+//finished pipelines at the start of a frame, so a swap never happens in the middle of one.
+struct shadercompiler {
+	struct job {
+		uint32_t id;
+		std::string name;
+		ID3D12Device *dev;
+		ID3D12RootSignature *rootsig;
+		int kind;
+		bool is_bindless;
+	};
+	struct result {
+		uint32_t id;
+		ID3D12PipelineState *pstate;
+		double compile_ms;
+		job source;
+	};
+	std::vector<std::thread> vthread;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::vector<job> vjob;
+	std::vector<result> vresult;
+	bool quit = false;
+
+	void start(size_t thread_count)
+	{
+		quit = false;
+		for(size_t i = 0 ; i < thread_count; i++)
+			vthread.emplace_back([this] { loop(); });
+	}
+
+	//Waits for the compiles in progress, queued jobs are dropped.
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			quit = true;
+			vjob.clear();
+		}
+		wake.notify_all();
+		for(auto & x : vthread)
+			x.join();
+		vthread.clear();
+	}
+
+	void loop()
+	{
+		for(;;) {
+			job x;
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				wake.wait(lk, [&] { return quit || !vjob.empty(); });
+				if(quit)
+					return;
+				x = vjob.front();
+				vjob.erase(vjob.begin());
+			}
+			auto start = GetMicroSeconds();
+			auto pstate = x.kind == PIPELINE_COMPUTE ?
+				CreateComputePipeline(x.dev, x.rootsig, x.name.c_str()) :
+				CreateGraphicsPipeline(x.dev, x.rootsig, x.name.c_str(), x.kind, x.is_bindless);
+			auto compile_ms = (GetMicroSeconds() - start) / 1000.0;
+			std::lock_guard<std::mutex> lk(lock);
+			vresult.push_back({x.id, pstate, compile_ms, x});
+		}
+	}
+
+	void push(const job & x)
+	{
+		{
+			std::lock_guard<std::mutex> lk(lock);
+			vjob.push_back(x);
+		}
+		wake.notify_one();
+	}
+
+	std::vector<result> poll()
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		std::vector<result> ret;
+		ret.swap(vresult);
+		return ret;
+	}
+};
+
+//Persistently mapped upload memory for one frame in flight. Slices are handed out linearly and the
+//whole ring is reused once the frame's fence has completed.
+struct uploadring {
+	static const size_t Alignment = 256;
+	ID3D12Resource *res = nullptr;
+	uint8_t *cpu = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS gpu = 0;
+	size_t size = 0;
+	size_t used = 0;
+
+	bool create(ID3D12Device *dev, size_t reserve)
+	{
+		res = CreateResource("uploadring", dev, int(reserve), 1, DXGI_FORMAT_UNKNOWN,
+			D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, TRUE);
+		if(res == nullptr)
+			return false;
+		D3D12_RANGE range = {0, 0};
+		res->Map(0, &range, reinterpret_cast<void **>(&cpu));
+		if(cpu == nullptr) {
+			printf("%s : cant map\n", __FUNCTION__);
+			ReleaseResource(res);
+			res = nullptr;
+			return false;
+		}
+		gpu = res->GetGPUVirtualAddress();
+		size = reserve;
+		used = 0;
+		return true;
+	}
+
+	//Returns the offset of n bytes, or SIZE_MAX when the ring is full.
+	size_t reserve(size_t n, size_t align)
+	{
+		size_t offset = (used + align - 1) & ~(align - 1);
+		if(res == nullptr || offset + n > size)
+			return SIZE_MAX;
+		used = offset + n;
+		return offset;
+	}
+
+	//Returns 0 when the ring is full.
+	D3D12_GPU_VIRTUAL_ADDRESS alloc(const void *data, size_t n)
+	{
+		auto offset = reserve(n, Alignment);
+		if(offset == SIZE_MAX)
+			return 0;
+		memcpy(cpu + offset, data, n);
+		return gpu + offset;
+	}
+
+	void reset() { used = 0; }
+};
+
+//Texture uploads recorded on their own queue, so they do not run in front of the frame's draws.
+//One list per frame at most, on a ring of allocators. Each upload finishes at a value of the copy
+//fence, and the direct queue waits on it only in frames that bind or update the texture.
+struct copyqueue {
+	struct slot {
+		ID3D12CommandAllocator *cmdalloc;
+		uint64_t value;
+		std::vector<ID3D12Resource *> vstaging; //Borrowed from GraphicsDevice::scratch until value completes.
+	};
+	ID3D12CommandQueue *queue = nullptr;
+	ID3D12GraphicsCommandList *cmdlist = nullptr;
+	ID3D12Fence *fence = nullptr;
+	std::vector<slot> vslot;
+	uint32_t index = 0;
+	bool is_open = false;
+	uint64_t value = 0;     //Last value signaled.
+	uint64_t completed = 0; //Seen at the start of the frame.
+	uint64_t ready = 0;     //Uploads up to this value are bound as themselves this frame.
+	uint64_t need = 0;      //The frame waits for this value before it runs.
+	uint64_t waited = 0;    //The direct queue has waited up to this value.
+	uint64_t placeholder_count = 0;
+};
+
+struct DeviceBuffer {
+	ID3D12CommandAllocator *cmdalloc = nullptr;
+	ID3D12GraphicsCommandList *cmdlist = nullptr;
+	ID3D12Fence *fence = nullptr;
+	std::vector<ID3D12CommandAllocator *> vsegalloc;
+	std::vector<ID3D12GraphicsCommandList *> vseglist;
+	std::vector<uint64_t> vseghash; //What each segment list holds, 0 when it must be recorded.
+	std::vector<ID3D12Resource *> vscratch;
+	std::vector<ID3D12Resource *> vstaging; //Borrowed from GraphicsDevice::scratch until the fence completes.
+	uploadring ring;
+	cmdbuffer vcmd;
+	uint64_t value = 0;
+	double submit_us = 0.0;
+};
+
+const uint64_t InvalidHandle = ~0ull;
+const D3D12_RESOURCE_STATES StateUnknown = D3D12_RESOURCE_STATES(-1);
+//Textures may be read by pixel and compute shaders alike.
+const D3D12_RESOURCE_STATES StateShaderResource =
+	D3D12_RESOURCE_STATES(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+struct barrierflush {
+	const cmdheader *at;
+	uint32_t begin;
+	uint32_t count;
+};
+
+//Transitions inferred from the stream, grouped into one ResourceBarrier call per flush point.
+//Resources may not exist yet while planning, so barriers keep the id and get pResource at flush time.
+struct barrierplan {
+	std::vector<D3D12_RESOURCE_BARRIER> vbarrier;
+	std::vector<uint32_t> vid;
+	std::vector<barrierflush> vflush;
+	std::vector<uint32_t> vreleased;
+	std::vector<uint32_t> vuav;     //Bound per UAV slot.
+	std::vector<uint8_t> vwritten;  //Per id, written by a dispatch since its last barrier.
+	uint32_t batch_begin = 0;
+	bool allow_split = true;
+
+	void clear()
+	{
+		vbarrier.clear();
+		vid.clear();
+		vflush.clear();
+		vreleased.clear();
+		batch_begin = 0;
+	}
+};
+
+//What the command list has bound, as seen by EliminateRedundantState.
+struct boundstate {
+	uint32_t rendertarget = ~0u;
+	rect_t rect = {};
+	uint32_t shader = ~0u;
+	const set_vertex_t *vertex = nullptr;
+	uint32_t vertex_id = ~0u;
+	const set_index_t *index = nullptr;
+	uint32_t index_id = ~0u;
+	std::vector<uint32_t> vtexture;
+	std::vector<const cmdheader *> vconstant;
+	bool is_compute = false;
+	bool is_prepass = false;
+	bool has_depth = false;
+
+	void reset(size_t slotmax)
+	{
+		is_compute = false;
+		is_prepass = false;
+		has_depth = false;
+		rendertarget = ~0u;
+		shader = ~0u;
+		vertex = nullptr;
+		vertex_id = ~0u;
+		index = nullptr;
+		index_id = ~0u;
+		vtexture.assign(slotmax, ~0u);
+		vconstant.assign(slotmax, nullptr);
+	}
+};
+
+//A draw and every binding in effect for it, as a range of drawsorter::vpacketcmd.
+struct drawpacket {
+	uint64_t key;
+	uint32_t begin;
+	uint32_t count;
+};
+
+//Bindings as recorded, and the packets of the run being sorted. See SortDraws.
+struct drawsorter {
+	const cmdheader *shader = nullptr;
+	const cmdheader *vertex = nullptr;
+	const cmdheader *index = nullptr;
+	std::vector<const cmdheader *> vtexture;
+	std::vector<const cmdheader *> vconstant;
+	bool is_compute = false;
+	std::vector<drawpacket> vpacket;
+	std::vector<drawpacket> vtemp;
+	std::vector<const cmdheader *> vpacketcmd;
+	cmdbuffer vsorted;
+
+	void reset(size_t slotmax)
+	{
+		is_compute = false;
+		shader = nullptr;
+		vertex = nullptr;
+		index = nullptr;
+		vtexture.assign(slotmax, nullptr);
+		vconstant.assign(slotmax, nullptr);
+		vpacket.clear();
+		vpacketcmd.clear();
+		vsorted.clear();
+	}
+
+	//Shader, vertex, index, textures and constants, skipping what was never set.
+	template<typename F>
+	void foreach_binding(F func) const
+	{
+		for(auto c : {shader, vertex, index})
+			if(c)
+				func(c);
+		for(auto c : vtexture)
+			if(c)
+				func(c);
+		for(auto c : vconstant)
+			if(c)
+				func(c);
+	}
+};
+
+//Bindings as recorded, and the run of commands waiting for its pre-pass. See AddDepthPrepass.
+struct depthprepass {
+	const cmdheader *shader = nullptr;
+	const cmdheader *vertex = nullptr;
+	const cmdheader *index = nullptr;
+	std::vector<const cmdheader *> vconstant;
+	std::vector<const cmdheader *> vrestore; //Bindings in effect when the run started.
+	std::vector<const cmdheader *> vrun;
+	std::vector<const cmdheader *> vprepass;
+	bool has_depth = false;
+	bool is_compute = false;
+	cmdbuffer vout;
+
+	void reset(size_t slotmax)
+	{
+		shader = nullptr;
+		vertex = nullptr;
+		index = nullptr;
+		vconstant.assign(slotmax, nullptr);
+		vrestore.clear();
+		vrun.clear();
+		vprepass.clear();
+		has_depth = false;
+		is_compute = false;
+		vout.clear();
+	}
+
+	//Only what the vertex shader needs. Textures are left to the shading pass.
+	template<typename F>
+	void foreach_binding(F func) const
+	{
+		for(auto c : {shader, vertex, index})
+			if(c)
+				func(c);
+		for(auto c : vconstant)
+			if(c)
+				func(c);
+	}
+};
+
+//A run of the stream recorded into its own command list. It starts at a render target change and
+//first replays the bindings still in effect from the segments before it.
+struct segment {
+	cmdheader *begin;
+	cmdheader *end;
+	uint32_t flush_begin;
+	uint32_t inherit_begin;
+	uint32_t inherit_count;
+};
+
+//Render targets that only live within a frame. Their lifetimes in the stream are packed into one heap,
+//so targets that are never alive at the same time share memory. A placed resource and its views are
+//kept for each place and size, and reused by whichever name lands there in a later frame.
+struct transientpool {
+	struct target {
+		ID3D12Resource *res;
+		uint64_t offset;
+		int w, h;
+		uint64_t rtv;
+		uint64_t srv;
+		D3D12_RESOURCE_STATES state; //At the end of the last frame that used it.
+		uint64_t frame;
+	};
+	struct lifetime {
+		uint32_t id;
+		uint32_t first, last; //Command indices in the stream.
+		const cmdheader *begin;
+		int w, h;
+		uint64_t size, align;
+		uint64_t offset;
+		uint32_t target;
+	};
+	ID3D12Heap *heap = nullptr;
+	uint64_t heap_size = 0;
+	std::vector<target> vtarget;
+	std::vector<lifetime> vlife;
+	std::vector<uint32_t> vlife_index; //Per id, into vlife for this frame, ~0u when not alive.
+	std::vector<uint32_t> vactive;     //Into vlife, by offset.
+	std::vector<uint32_t> vbound;      //Texture slots, graphics then compute.
+	uint64_t total_bytes = 0;
+	uint64_t peak_bytes = 0;
+};
+
+//Objects and descriptor slots of a released name, kept until the last frame that used them completes,
+//and until the copy queue finished uploading the texture.
+struct pendingrelease {
+	ID3D12Resource *res;
+	ID3D12Resource *depth;
+	ID3D12PipelineState *pstate;
+	uint64_t rtv;
+	uint64_t dsv;
+	uint64_t shader;
+	uint64_t uav;
+	uint64_t frame;
+	uint64_t upload; //Copy fence value, see GraphicsDevice::vupload.
+};
+
+enum {
+	SHADER_IDLE,
+	SHADER_COMPILING,
+	SHADER_RELOAD, //Compiling, and compile again when it finishes.
+	SHADER_FAILED, //Waits for the next reload request.
+};
+
+struct GraphicsDevice {
+	std::vector<DeviceBuffer> devicebuffer;
+	ID3D12Device *dev = nullptr;
+	ID3D12CommandQueue *queue = nullptr;
+	IDXGISwapChain3 *swapchain = nullptr;
+	ID3D12DescriptorHeap *heap_rtv = nullptr;
+	ID3D12DescriptorHeap *heap_dsv = nullptr;
+	ID3D12DescriptorHeap *heap_shader = nullptr;
+	ID3D12RootSignature *rootsig = nullptr;
+	ID3D12RootSignature *rootsig_compute = nullptr;
+	ID3D12CommandSignature *cmdsig_draw_indexed = nullptr;
+	std::vector<ID3D12Resource *> vres;
+	std::vector<ID3D12PipelineState *> vpstate;
+	std::vector<uint64_t> vcpu_handle;
+	std::vector<uint64_t> vgpu_handle;
+	std::vector<uint64_t> vuav_handle;
+	std::vector<ID3D12Resource *> vdepth; //Depth buffer of a render target.
+	std::vector<uint64_t> vdsv_handle;
+	std::vector<uint32_t> vdepth_pipeline; //Names of a shader's PIPELINE_DEPTH and PIPELINE_PREPASS variants.
+	std::vector<uint32_t> vprepass_pipeline;
+	std::vector<D3D12_RESOURCE_STATES> vstate;
+	std::vector<D3D12_RESOURCE_STATES> vsplit;
+	std::vector<uint32_t> vbackbuffer;
+	barrierplan plan;
+	boundstate bound;
+	drawsorter sorter;
+	depthprepass prepass;
+	transientpool transient;
+	copyqueue copy;
+	scratchpool scratch;
+	std::vector<segment> vsegment;
+	std::vector<const cmdheader *> vinherit;
+	workerpool pool;
+	UINT thread_count = 1;
+	UINT slotmax = 0;
+	uint64_t handle_index_rtv = 0;
+	uint64_t handle_index_dsv = 0;
+	uint64_t handle_index_shader = 0;
+	std::vector<uint64_t> vfree_rtv;
+	std::vector<uint64_t> vfree_dsv;
+	std::vector<uint64_t> vfree_shader;
+	std::vector<uint64_t> vlast_used;
+	std::vector<uint8_t> vcompile;
+	std::vector<uint8_t> vtransient; //Names last set with SetTransientRenderTarget.
+	std::vector<uint64_t> vupload;   //Copy fence value the texture's upload completes at.
+	ID3D12Resource *placeholder = nullptr; //Bound in place of textures still uploading.
+	uint64_t placeholder_srv = InvalidHandle;
+	bool is_copy_queue = false;
+	shadercompiler compiler;
+	bool shader_ready = false;
+	bool compute_ready = false;
+	bool is_compute = false; //Set by the last shader command the prepare pass saw.
+	bool has_depth = false;  //Set by the last render target the prepare pass saw.
+	bool is_bindless = false; //Graphics root signature layout, see PresentGraphics.
+	uint64_t update_bytes = 0; //Texture bytes staged by CMD_UPDATE_TEXTURE this frame.
+	uint64_t reuse_epoch = 0;  //Bumped when objects are released, so no cached list can match a reused pointer.
+	std::vector<uint32_t> vrelease_id;
+	std::vector<pendingrelease> vpending;
+	uint64_t completed_frame = 0;
+	uint64_t released_count = 0;
+	HANDLE fence_event = nullptr;   //Reused by every WaitFence.
+	HANDLE latency_event = nullptr; //Frame latency waitable object of the swap chain.
+	UINT max_frames = 0;
+	double wait_us = 0.0;
+	uint64_t deviceindex = 0;
+	uint64_t frame_count = 0;
+};
+
+void GrowIdTables(GraphicsDevice & gd)
+{
+	//Names may be interned at any time while recording, so grow the id tables before translating.
+	auto namecount = GetNameCount();
+	if(gd.vres.size() < namecount) {
+		gd.vres.resize(namecount, nullptr);
+		gd.vpstate.resize(namecount, nullptr);
+		gd.vcpu_handle.resize(namecount, InvalidHandle);
+		gd.vgpu_handle.resize(namecount, InvalidHandle);
+		gd.vuav_handle.resize(namecount, InvalidHandle);
+		gd.vdepth.resize(namecount, nullptr);
+		gd.vdsv_handle.resize(namecount, InvalidHandle);
+		gd.vdepth_pipeline.resize(namecount, ~0u);
+		gd.vprepass_pipeline.resize(namecount, ~0u);
+		gd.vstate.resize(namecount, StateUnknown);
+		gd.vsplit.resize(namecount, StateUnknown);
+		gd.vlast_used.resize(namecount, 0);
+		gd.vcompile.resize(namecount, SHADER_IDLE);
+		gd.vtransient.resize(namecount, 0);
+		gd.vupload.resize(namecount, 0);
+	}
+}
+
+//Prepare functions run on the calling thread in stream order and create everything a command needs:
+//resources, descriptors, pipeline states and texture uploads. Exec functions only record into the
+//command list they are given, so render target segments can be recorded on worker threads.
+//Reuses a slot given back by RetireName before growing the heap.
+uint64_t AllocDescriptor(std::vector<uint64_t> & vfree, uint64_t & next)
+{
+	if(vfree.empty())
+		return next++;
+	auto index = vfree.back();
+	vfree.pop_back();
+	return index;
+}
+
+void PrepareNop(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+}
+
+void PrepareSetRenderTarget(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_render_target = GetPayload<set_render_target_t>(c);
+	auto dev = gd.dev;
+	auto res = gd.vres[id];
+	auto fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	if(res == nullptr) {
+		res = CreateResource(GetName(id), dev, set_render_target.rect.w, set_render_target.rect.h, fmt,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET, D3D12_RESOURCE_STATE_RENDER_TARGET);
+		gd.vres[id] = res;
+	}
+
+	if(gd.vcpu_handle[id] == InvalidHandle) {
+		auto cpu_handle = gd.heap_rtv->GetCPUDescriptorHandleForHeapStart();
+		D3D12_RENDER_TARGET_VIEW_DESC desc = {};
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.Texture2D.MipSlice = 0;
+		desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+		auto index = AllocDescriptor(gd.vfree_rtv, gd.handle_index_rtv);
+		cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * index;
+		dev->CreateRenderTargetView(res, &desc, cpu_handle);
+		gd.vcpu_handle[id] = index;
+	};
+
+	gd.has_depth = set_render_target.has_depth;
+	if(!set_render_target.has_depth)
+		return;
+	if(gd.vdepth[id] == nullptr) {
+		gd.vdepth[id] = CreateResource(GetName(id), dev, set_render_target.rect.w, set_render_target.rect.h, DXGI_FORMAT_D32_FLOAT,
+			D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	}
+	if(gd.vdsv_handle[id] == InvalidHandle && gd.vdepth[id]) {
+		auto cpu_handle = gd.heap_dsv->GetCPUDescriptorHandleForHeapStart();
+		D3D12_DEPTH_STENCIL_VIEW_DESC desc = {};
+		desc.Format = DXGI_FORMAT_D32_FLOAT;
+		desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+		auto index = AllocDescriptor(gd.vfree_dsv, gd.handle_index_dsv);
+		cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV) * index;
+		dev->CreateDepthStencilView(gd.vdepth[id], &desc, cpu_handle);
+		gd.vdsv_handle[id] = index;
+	}
+}
+
+//Waits on the event created with the device and adds the time blocked to the frame's wait.
+void WaitFence(GraphicsDevice & gd, ID3D12Fence *fence, uint64_t value)
+{
+	if(fence->GetCompletedValue() >= value)
+		return;
+	auto start = GetMicroSeconds();
+	fence->SetEventOnCompletion(value, gd.fence_event);
+	WaitForSingleObject(gd.fence_event, INFINITE);
+	gd.wait_us += GetMicroSeconds() - start;
+}
+
+//Opens the frame's copy list on the next allocator of the ring, once that allocator's last list has run.
+ID3D12GraphicsCommandList * OpenCopyList(GraphicsDevice & gd)
+{
+	auto & copy = gd.copy;
+	if(copy.is_open)
+		return copy.cmdlist;
+	auto & slot = copy.vslot[copy.index];
+	WaitFence(gd, copy.fence, slot.value);
+	for(auto staging : slot.vstaging)
+		gd.scratch.recycle(staging, gd.frame_count);
+	slot.vstaging.clear();
+	slot.cmdalloc->Reset();
+	copy.cmdlist->Reset(slot.cmdalloc, nullptr);
+	copy.is_open = true;
+	return copy.cmdlist;
+}
+
+//Runs the frame's uploads on the copy queue ahead of the direct queue's wait for them.
+void SubmitCopies(GraphicsDevice & gd)
+{
+	auto & copy = gd.copy;
+	if(!copy.is_open)
+		return;
+	copy.cmdlist->Close();
+	ID3D12CommandList *list = copy.cmdlist;
+	copy.queue->ExecuteCommandLists(1, &list);
+	copy.queue->Signal(copy.fence, ++copy.value);
+	copy.vslot[copy.index].value = copy.value;
+	copy.index = (copy.index + 1) % copy.vslot.size();
+	copy.is_open = false;
+}
+
+//Copies data into a texture created in COPY_DEST, with the copy recorded on cmdlist.
+void CopyTexture(ID3D12Device *dev, ID3D12GraphicsCommandList *cmdlist, ID3D12Resource *res, ID3D12Resource *scratch)
+{
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
+	D3D12_TEXTURE_COPY_LOCATION dest = {};
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	D3D12_RESOURCE_DESC desc_res = res->GetDesc();
+	UINT64 total_bytes = 0;
+	UINT subres_index = 0;
+
+	dev->GetCopyableFootprints(&desc_res, subres_index, 1, 0, &footprint, nullptr, nullptr, &total_bytes);
+	dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	dest.pResource = res;
+	src.pResource = scratch;
+
+	dest.SubresourceIndex = subres_index;
+	src.PlacedFootprint = footprint;
+	cmdlist->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr );
+}
+
+uint64_t CreateShaderView(GraphicsDevice & gd, ID3D12Resource *res)
+{
+	auto dev = gd.dev;
+	auto cpu_handle = gd.heap_shader->GetCPUDescriptorHandleForHeapStart();
+	D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	desc.Texture2D.MipLevels = 1;
+	auto index = AllocDescriptor(gd.vfree_shader, gd.handle_index_shader);
+	cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * index;
+	dev->CreateShaderResourceView(res, &desc, cpu_handle);
+	return index;
+}
+
+//A small grey texture uploaded on the direct list, so it is a shader resource before any draw of the frame.
+void CreatePlaceholder(GraphicsDevice & gd, DeviceBuffer & ref)
+{
+	static const uint32_t vtexel[4 * 4] = {
+		0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080,
+		0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080, 0xFF808080,
+	};
+	auto res = CreateResource("placeholder", gd.dev, 4, 4, DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+	auto scratch = gd.scratch.acquire(gd.dev, vtexel, sizeof(vtexel));
+	if(res == nullptr || scratch == nullptr) {
+		ReleaseResource(res);
+		return;
+	}
+	ref.vstaging.push_back(scratch);
+	CopyTexture(gd.dev, ref.cmdlist, res, scratch);
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Transition.pResource = res;
+	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+	barrier.Transition.StateAfter = StateShaderResource;
+	ref.cmdlist->ResourceBarrier(1, &barrier);
+	gd.placeholder = res;
+	gd.placeholder_srv = CreateShaderView(gd, res);
+}
+
+void PrepareSetTexture(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_texture = GetPayload<set_texture_t>(c);
+	set_texture.is_compute = gd.is_compute;
+	auto dev = gd.dev;
+	auto res = gd.vres[id];
+	auto w = set_texture.rect.w;
+	auto h = set_texture.rect.h;
+	auto fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	//With the copy queue the texture starts in COMMON, which the copy promotes to COPY_DEST and decays
+	//back to, and the direct queue makes it a shader resource once it has waited for the upload.
+	if(res == nullptr) {
+		auto state = gd.is_copy_queue ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_COPY_DEST;
+		res = CreateResource(GetName(id), dev, w, h, fmt, D3D12_RESOURCE_FLAG_NONE, state);
+		auto scratch = res ? gd.scratch.acquire(dev, set_texture.data, set_texture.size) : nullptr;
+		gd.vupload[id] = 0;
+		//PlanBarriers already moved the name to a state, and FlushBarriers skips the barriers of a
+		//name without a resource. The next frame that sets the texture creates it again.
+		if(scratch == nullptr) {
+			ReleaseResource(res);
+			gd.vstate[id] = StateUnknown;
+			gd.vsplit[id] = StateUnknown;
+			c->type = CMD_NOP;
+			return;
+		}
+		gd.vres[id] = res;
+		if(gd.is_copy_queue) {
+			CopyTexture(dev, OpenCopyList(gd), res, scratch);
+			gd.copy.vslot[gd.copy.index].vstaging.push_back(scratch);
+			gd.vupload[id] = gd.copy.value + 1;
+		} else {
+			CopyTexture(dev, ref.cmdlist, res, scratch);
+			ref.vstaging.push_back(scratch);
+		}
+	}
+	if(gd.vgpu_handle[id] == InvalidHandle)
+		gd.vgpu_handle[id] = CreateShaderView(gd, res);
+}
+
+void PrepareSetVertex(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_vertex = GetPayload<set_vertex_t>(c);
+	if(gd.vres[id] == nullptr) {
+		gd.vres[id] = CreateResource(GetName(id), gd.dev, set_vertex.size, 1,
+			DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, TRUE, set_vertex.data, set_vertex.size);
+	}
+}
+
+void PrepareSetIndex(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_index = GetPayload<set_index_t>(c);
+	if(gd.vres[id] == nullptr) {
+		gd.vres[id] = CreateResource(GetName(id), gd.dev, set_index.size, 1,
+			DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, TRUE, set_index.data, set_index.size);
+	}
+}
+
+//Queues a compile when the pipeline is missing or a reload was asked for, and returns whether the
+//current pipeline can be used.
+bool RequestPipeline(GraphicsDevice & gd, uint32_t id, uint32_t file, bool is_update, int kind)
+{
+	auto & compile = gd.vcompile[id];
+	if(compile == SHADER_COMPILING || compile == SHADER_RELOAD) {
+		if(is_update)
+			compile = SHADER_RELOAD;
+	} else if(is_update || (gd.vpstate[id] == nullptr && compile != SHADER_FAILED)) {
+		compile = SHADER_COMPILING;
+		gd.compiler.push({id, GetName(file), gd.dev, kind == PIPELINE_COMPUTE ? gd.rootsig_compute : gd.rootsig, kind, gd.is_bindless});
+	}
+	return gd.vpstate[id] != nullptr;
+}
+
+//The depth and pre-pass pipelines of a shader are kept under names of their own, so they are
+//compiled, swapped, released and evicted like any other name.
+uint32_t GetPipelineId(GraphicsDevice & gd, uint32_t id, int kind)
+{
+	if(kind != PIPELINE_DEPTH && kind != PIPELINE_PREPASS)
+		return id;
+	auto is_depth = kind == PIPELINE_DEPTH;
+	auto variant = is_depth ? gd.vdepth_pipeline[id] : gd.vprepass_pipeline[id];
+	if(variant == ~0u) {
+		variant = GetNameId(std::string(GetName(id)) + (is_depth ? "#depth" : "#prepass"));
+		GrowIdTables(gd);
+		(is_depth ? gd.vdepth_pipeline : gd.vprepass_pipeline)[id] = variant;
+	}
+	gd.vlast_used[variant] = gd.vlast_used[id];
+	return variant;
+}
+
+//Graphics and compute pipelines share the command list's pipeline slot, so each one unbinds the other.
+//The variant follows the render target: depth tested when it has a depth buffer.
+void PrepareSetShader(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_shader = GetPayload<set_shader_t>(c);
+	auto kind = set_shader.is_prepass ? PIPELINE_PREPASS : gd.has_depth ? PIPELINE_DEPTH : PIPELINE_COLOR;
+	if(set_shader.is_update) {
+		//The other variants already in use are rebuilt from the same file too.
+		uint32_t vvariant[] = {id, gd.vdepth_pipeline[id], gd.vprepass_pipeline[id]};
+		for(int x = PIPELINE_COLOR; x <= PIPELINE_PREPASS; x++)
+			if(x != kind && vvariant[x] != ~0u && gd.vpstate[vvariant[x]])
+				RequestPipeline(gd, vvariant[x], id, true, x);
+	}
+	set_shader.pipeline = GetPipelineId(gd, id, kind);
+	gd.shader_ready = RequestPipeline(gd, set_shader.pipeline, id, set_shader.is_update, kind);
+	gd.compute_ready = false;
+	gd.is_compute = false;
+}
+
+void PrepareSetComputeShader(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	gd.compute_ready = RequestPipeline(gd, c->id, c->id, GetPayload<set_compute_shader_t>(c).is_update, PIPELINE_COMPUTE);
+	gd.shader_ready = false;
+	gd.is_compute = true;
+}
+
+//Drops draws that have no pipeline yet, so the frame goes on while the shader compiles.
+void PrepareDrawIndex(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	if(!gd.shader_ready)
+		c->type = CMD_NOP;
+}
+
+//The argument buffer lives in an upload heap, so it is always readable as indirect arguments.
+void PrepareDrawIndirect(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & draw_indirect = GetPayload<draw_indirect_t>(c);
+	if(gd.vres[id] == nullptr && draw_indirect.data) {
+		gd.vres[id] = CreateResource(GetName(id), gd.dev, draw_indirect.size, 1,
+			DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, TRUE, draw_indirect.data, draw_indirect.size);
+	}
+	if(!gd.shader_ready || gd.vres[id] == nullptr)
+		c->type = CMD_NOP;
+}
+
+//Returns the offset of n bytes in the frame's ring, growing the ring when it is full, or SIZE_MAX.
+size_t ReserveRing(GraphicsDevice & gd, DeviceBuffer & ref, size_t n, size_t align)
+{
+	auto & ring = ref.ring;
+	auto offset = ring.reserve(n, align);
+	if(offset == SIZE_MAX) {
+		//The old ring is still referenced by this frame, so retire it with the frame's scratch.
+		auto reserve = std::max(ring.size * 2, n + align);
+		if(ring.res)
+			ref.vscratch.push_back(ring.res);
+		ring = uploadring();
+		if(ring.create(gd.dev, reserve))
+			offset = ring.reserve(n, align);
+	}
+	return offset;
+}
+
+//Each write gets its own slice of the frame's ring, so the GPU never reads memory that a later
+//command or frame overwrites.
+void PrepareSetConstant(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto & set_constant = GetPayload<set_constant_t>(c);
+	set_constant.is_compute = gd.is_compute;
+	set_constant.gpu_address = 0;
+	auto offset = ReserveRing(gd, ref, set_constant.size, uploadring::Alignment);
+	if(offset == SIZE_MAX)
+		return;
+	memcpy(ref.ring.cpu + offset, set_constant.data, set_constant.size);
+	set_constant.gpu_address = ref.ring.gpu + offset;
+}
+
+//Stages only the rows of the rect into the frame's ring, clipped to the texture. The copy is
+//recorded in stream order by ExecUpdateTexture, between the barriers PlanBarriers adds around it.
+void PrepareUpdateTexture(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto & update_texture = GetPayload<update_texture_t>(c);
+	auto res = gd.vres[c->id];
+	auto & rect = update_texture.rect;
+	if(res == nullptr || update_texture.data == nullptr) {
+		c->type = CMD_NOP;
+		return;
+	}
+	auto desc = res->GetDesc();
+	auto x0 = std::max(rect.x, 0);
+	auto y0 = std::max(rect.y, 0);
+	auto x1 = std::min<int64_t>(int64_t(rect.x) + rect.w, int64_t(desc.Width));
+	auto y1 = std::min<int64_t>(int64_t(rect.y) + rect.h, int64_t(desc.Height));
+	if(x1 <= x0 || y1 <= y0) {
+		c->type = CMD_NOP;
+		return;
+	}
+	auto src = (const uint8_t *)update_texture.data + size_t(y0 - rect.y) * update_texture.pitch + size_t(x0 - rect.x) * sizeof(uint32_t);
+	rect = {x0, y0, int(x1 - x0), int(y1 - y0)};
+
+	size_t row_size = size_t(rect.w) * sizeof(uint32_t);
+	size_t row_pitch = (row_size + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) & ~size_t(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+	auto offset = ReserveRing(gd, ref, row_pitch * rect.h, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	if(offset == SIZE_MAX) {
+		c->type = CMD_NOP;
+		return;
+	}
+	for(int y = 0 ; y < rect.h; y++)
+		memcpy(ref.ring.cpu + offset + y * row_pitch, src + y * update_texture.pitch, row_size);
+	update_texture.staging = ref.ring.res;
+	update_texture.offset = offset;
+	update_texture.row_pitch = uint32_t(row_pitch);
+	gd.update_bytes += row_size * rect.h;
+}
+
+void PrepareSetUav(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	auto id = c->id;
+	auto & set_uav = GetPayload<set_uav_t>(c);
+	auto dev = gd.dev;
+	auto is_buffer = set_uav.size != 0;
+	if(gd.vres[id] == nullptr) {
+		if(is_buffer)
+			gd.vres[id] = CreateResource(GetName(id), dev, int(set_uav.size), 1, DXGI_FORMAT_UNKNOWN,
+				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		else
+			gd.vres[id] = CreateResource(GetName(id), dev, set_uav.rect.w, set_uav.rect.h, DXGI_FORMAT_R8G8B8A8_UNORM,
+				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}
+	if(gd.vuav_handle[id] == InvalidHandle && gd.vres[id]) {
+		auto cpu_handle = gd.heap_shader->GetCPUDescriptorHandleForHeapStart();
+		D3D12_UNORDERED_ACCESS_VIEW_DESC desc = {};
+		if(is_buffer) {
+			auto stride = std::max<size_t>(set_uav.stride_size, 4);
+			desc.Format = DXGI_FORMAT_UNKNOWN;
+			desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+			desc.Buffer.NumElements = UINT(set_uav.size / stride);
+			desc.Buffer.StructureByteStride = UINT(stride);
+		} else {
+			desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+		}
+		auto index = AllocDescriptor(gd.vfree_shader, gd.handle_index_shader);
+		cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * index;
+		dev->CreateUnorderedAccessView(gd.vres[id], nullptr, &desc, cpu_handle);
+		gd.vuav_handle[id] = index;
+	}
+}
+
+void PrepareDispatch(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	if(!gd.compute_ready)
+		c->type = CMD_NOP;
+}
+
+//The name stays usable until the end of the frame, see RetireName.
+void PrepareRelease(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c)
+{
+	gd.vrelease_id.push_back(c->id);
+}
+
+void ExecNop(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+}
+
+void ExecSetRenderTarget(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_render_target = GetPayload<set_render_target_t>(c);
+	auto x = set_render_target.rect.x;
+	auto y = set_render_target.rect.y;
+	auto w = set_render_target.rect.w;
+	auto h = set_render_target.rect.h;
+	auto cpu_handle = gd.heap_rtv->GetCPUDescriptorHandleForHeapStart();
+	auto cpu_index = gd.vcpu_handle[c->id];
+	cpu_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * cpu_index;
+	D3D12_VIEWPORT viewport = { FLOAT(x), FLOAT(y), FLOAT(w), FLOAT(h), 0.0f, 1.0f };
+	D3D12_RECT rect = { x, y, w, h };
+	cmdlist->RSSetViewports(1, &viewport);
+	cmdlist->RSSetScissorRects(1, &rect);
+	auto dsv_index = gd.vdsv_handle[c->id];
+	if(set_render_target.has_depth && dsv_index != InvalidHandle) {
+		auto dsv_handle = gd.heap_dsv->GetCPUDescriptorHandleForHeapStart();
+		dsv_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV) * dsv_index;
+		cmdlist->OMSetRenderTargets(1, &cpu_handle, FALSE, &dsv_handle);
+	} else {
+		cmdlist->OMSetRenderTargets(1, &cpu_handle, FALSE, nullptr);
+	}
+}
+
+void ExecSetTexture(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_texture = GetPayload<set_texture_t>(c);
+	auto gpu_handle = gd.heap_shader->GetGPUDescriptorHandleForHeapStart();
+	auto slot = set_texture.slot;
+	auto gpu_index = set_texture.is_placeholder ? gd.placeholder_srv : gd.vgpu_handle[c->id];
+	gpu_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gpu_index;
+	if(set_texture.is_compute) {
+		cmdlist->SetComputeRootDescriptorTable((slot * 3) + 0, gpu_handle);
+	} else if(gd.is_bindless) {
+		auto index = UINT(gpu_index);
+		cmdlist->SetGraphicsRoot32BitConstants(0, 1, &index, UINT(slot));
+	} else {
+		cmdlist->SetGraphicsRootDescriptorTable((slot * 2) + 0, gpu_handle);
+	}
+}
+
+void ExecUpdateTexture(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & update_texture = GetPayload<update_texture_t>(c);
+	auto & rect = update_texture.rect;
+	D3D12_TEXTURE_COPY_LOCATION dest = {};
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	dest.pResource = gd.vres[c->id];
+	dest.SubresourceIndex = 0;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	src.pResource = update_texture.staging;
+	src.PlacedFootprint.Offset = update_texture.offset;
+	src.PlacedFootprint.Footprint = {DXGI_FORMAT_R8G8B8A8_UNORM, UINT(rect.w), UINT(rect.h), 1, update_texture.row_pitch};
+	D3D12_BOX box = {0, 0, 0, UINT(rect.w), UINT(rect.h), 1};
+	cmdlist->CopyTextureRegion(&dest, UINT(rect.x), UINT(rect.y), 0, &src, &box);
+}
+
+void ExecSetVertex(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_vertex = GetPayload<set_vertex_t>(c);
+	auto res = gd.vres[c->id];
+	//The prepare pass logs a buffer it could not create, and the draws after it keep the last one.
+	if(res == nullptr)
+		return;
+	D3D12_VERTEX_BUFFER_VIEW view = {
+		res->GetGPUVirtualAddress(), UINT(set_vertex.size), UINT(set_vertex.stride_size)
+	};
+	cmdlist->IASetVertexBuffers(0, 1, &view);
+	cmdlist->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+}
+
+void ExecSetIndex(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_index = GetPayload<set_index_t>(c);
+	auto res = gd.vres[c->id];
+	if(res == nullptr)
+		return;
+	D3D12_INDEX_BUFFER_VIEW view = {
+		res->GetGPUVirtualAddress(), UINT(set_index.size), DXGI_FORMAT_R32_UINT
+	};
+	cmdlist->IASetIndexBuffer(&view);
+}
+
+void ExecSetShader(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto pstate = gd.vpstate[GetPayload<set_shader_t>(c).pipeline];
+	if(pstate)
+		cmdlist->SetPipelineState(pstate);
+}
+
+void ExecSetComputeShader(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto pstate = gd.vpstate[c->id];
+	if(pstate)
+		cmdlist->SetPipelineState(pstate);
+}
+
+void ExecClear(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & clear = GetPayload<clear_t>(c);
+	auto cpu_handle = gd.heap_rtv->GetCPUDescriptorHandleForHeapStart();
+	auto index = gd.vcpu_handle[c->id];
+	cpu_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * index;
+	cmdlist->ClearRenderTargetView(cpu_handle, clear.color.data, 0, NULL);
+}
+
+void ExecClearDepth(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & clear_depth = GetPayload<clear_depth_t>(c);
+	auto index = gd.vdsv_handle[c->id];
+	if(index == InvalidHandle)
+		return;
+	auto cpu_handle = gd.heap_dsv->GetCPUDescriptorHandleForHeapStart();
+	cpu_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV) * index;
+	cmdlist->ClearDepthStencilView(cpu_handle, D3D12_CLEAR_FLAG_DEPTH, clear_depth.depth, 0, 0, nullptr);
+}
+
+void ExecSetConstant(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_constant = GetPayload<set_constant_t>(c);
+	if(set_constant.gpu_address == 0)
+		return;
+	if(set_constant.is_compute)
+		cmdlist->SetComputeRootConstantBufferView((set_constant.slot * 3) + 1, set_constant.gpu_address);
+	else if(gd.is_bindless)
+		cmdlist->SetGraphicsRootConstantBufferView(2 + set_constant.slot, set_constant.gpu_address);
+	else
+		cmdlist->SetGraphicsRootConstantBufferView((set_constant.slot * 2) + 1, set_constant.gpu_address);
+}
+
+void ExecDrawIndex(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & draw_index = GetPayload<draw_index_t>(c);
+	UINT IndexCountPerInstance = draw_index.count;
+	UINT InstanceCount = 1;
+	UINT StartIndexLocation = draw_index.start;
+	INT  BaseVertexLocation = 0;
+	UINT StartInstanceLocation = 0;
+	cmdlist->DrawIndexedInstanced(
+		IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+}
+
+void ExecDrawIndexedInstanced(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & draw = GetPayload<draw_indexed_instanced_t>(c);
+	cmdlist->DrawIndexedInstanced(
+		UINT(draw.index_count), UINT(draw.instance_count), UINT(draw.start_index), draw.base_vertex, UINT(draw.start_instance));
+}
+
+void ExecDrawIndirect(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & draw_indirect = GetPayload<draw_indirect_t>(c);
+	auto res = gd.vres[c->id];
+	if(res == nullptr)
+		return;
+	cmdlist->ExecuteIndirect(gd.cmdsig_draw_indexed, UINT(draw_indirect.max_count), res, draw_indirect.offset, nullptr, 0);
+}
+
+void ExecSetUav(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & set_uav = GetPayload<set_uav_t>(c);
+	auto gpu_handle = gd.heap_shader->GetGPUDescriptorHandleForHeapStart();
+	gpu_handle.ptr += gd.dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gd.vuav_handle[c->id];
+	cmdlist->SetComputeRootDescriptorTable((set_uav.slot * 3) + 2, gpu_handle);
+}
+
+void ExecDispatch(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c)
+{
+	auto & dispatch = GetPayload<dispatch_t>(c);
+	cmdlist->Dispatch(UINT(dispatch.x), UINT(dispatch.y), UINT(dispatch.z));
+}
+
+template<typename T>
+uint64_t HashValue(uint64_t h, const T & value)
+{
+	auto p = (const uint8_t *)&value;
+	for(size_t i = 0 ; i < sizeof(T); i++)
+		h = (h ^ p[i]) * 0x100000001B3ull;
+	return h;
+}
+
+//Hashes what the Exec function of the command reads, with the objects and descriptors it resolves
+//to. Constants only count by their ring address, their data is uploaded by the prepare pass.
+uint64_t HashCmd(const GraphicsDevice & gd, const cmdheader *c, uint64_t h)
+{
+	auto id = c->id;
+	h = HashValue(h, c->type);
+	h = HashValue(h, gd.vres[id]);
+	switch(c->type) {
+	case CMD_SET_RENDER_TARGET: {
+		auto & x = GetPayload<set_render_target_t>(c);
+		h = HashValue(h, x.rect);
+		h = HashValue(h, x.has_depth);
+		h = HashValue(h, gd.vcpu_handle[id]);
+		h = HashValue(h, gd.vdsv_handle[id]);
+		break;
+	}
+	case CMD_SET_TEXTURE: {
+		auto & x = GetPayload<set_texture_t>(c);
+		h = HashValue(h, x.slot);
+		h = HashValue(h, x.is_compute);
+		h = HashValue(h, x.is_placeholder ? gd.placeholder_srv : gd.vgpu_handle[id]);
+		break;
+	}
+	case CMD_UPDATE_TEXTURE: {
+		auto & x = GetPayload<update_texture_t>(c);
+		h = HashValue(h, x.rect);
+		h = HashValue(h, x.staging);
+		h = HashValue(h, x.offset);
+		h = HashValue(h, x.row_pitch);
+		break;
+	}
+	case CMD_SET_VERTEX: {
+		auto & x = GetPayload<set_vertex_t>(c);
+		h = HashValue(h, x.size);
+		h = HashValue(h, x.stride_size);
+		break;
+	}
+	case CMD_SET_INDEX:
+		h = HashValue(h, GetPayload<set_index_t>(c).size);
+		break;
+	case CMD_SET_CONSTANT: {
+		auto & x = GetPayload<set_constant_t>(c);
+		h = HashValue(h, x.slot);
+		h = HashValue(h, x.is_compute);
+		h = HashValue(h, x.gpu_address);
+		break;
+	}
+	case CMD_SET_SHADER:
+		h = HashValue(h, gd.vpstate[GetPayload<set_shader_t>(c).pipeline]);
+		break;
+	case CMD_SET_COMPUTE_SHADER:
+		h = HashValue(h, gd.vpstate[id]);
+		break;
+	case CMD_CLEAR:
+		h = HashValue(h, GetPayload<clear_t>(c).color);
+		h = HashValue(h, gd.vcpu_handle[id]);
+		break;
+	case CMD_CLEAR_DEPTH:
+		h = HashValue(h, GetPayload<clear_depth_t>(c).depth);
+		h = HashValue(h, gd.vdsv_handle[id]);
+		break;
+	case CMD_DRAW_INDEX: {
+		auto & x = GetPayload<draw_index_t>(c);
+		h = HashValue(h, x.start);
+		h = HashValue(h, x.count);
+		break;
+	}
+	case CMD_DRAW_INDEXED_INSTANCED: {
+		auto & x = GetPayload<draw_indexed_instanced_t>(c);
+		h = HashValue(h, x.index_count);
+		h = HashValue(h, x.instance_count);
+		h = HashValue(h, x.start_index);
+		h = HashValue(h, x.base_vertex);
+		h = HashValue(h, x.start_instance);
+		break;
+	}
+	case CMD_DRAW_INDIRECT: {
+		auto & x = GetPayload<draw_indirect_t>(c);
+		h = HashValue(h, x.offset);
+		h = HashValue(h, x.max_count);
+		break;
+	}
+	case CMD_SET_UAV:
+		h = HashValue(h, GetPayload<set_uav_t>(c).slot);
+		h = HashValue(h, gd.vuav_handle[id]);
+		break;
+	case CMD_DISPATCH:
+		h = HashValue(h, GetPayload<dispatch_t>(c));
+		break;
+	}
+	return h;
+}
+
+typedef void (*PrepareFunc)(GraphicsDevice & gd, DeviceBuffer & ref, cmdheader *c);
+typedef void (*ExecFunc)(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const cmdheader *c);
+
+//Indexed by cmdheader::type, so preparing or translating a command is a single indirect call.
+const PrepareFunc prepare_table[] = {
+	PrepareNop,             //CMD_NOP
+	PrepareNop,             //CMD_SET_BARRIER
+	PrepareSetRenderTarget, //CMD_SET_RENDER_TARGET
+	PrepareSetTexture,      //CMD_SET_TEXTURE
+	PrepareUpdateTexture,   //CMD_UPDATE_TEXTURE
+	PrepareSetVertex,       //CMD_SET_VERTEX
+	PrepareSetIndex,        //CMD_SET_INDEX
+	PrepareSetConstant,     //CMD_SET_CONSTANT
+	PrepareSetShader,       //CMD_SET_SHADER
+	PrepareNop,             //CMD_CLEAR
+	PrepareNop,             //CMD_CLEAR_DEPTH
+	PrepareDrawIndex,       //CMD_DRAW_INDEX
+	PrepareDrawIndex,       //CMD_DRAW_INDEXED_INSTANCED
+	PrepareDrawIndirect,    //CMD_DRAW_INDIRECT
+	PrepareSetComputeShader, //CMD_SET_COMPUTE_SHADER
+	PrepareSetUav,          //CMD_SET_UAV
+	PrepareDispatch,        //CMD_DISPATCH
+	PrepareRelease,         //CMD_RELEASE
+	PrepareNop,             //CMD_QUIT
+};
+static_assert(_countof(prepare_table) == CMD_MAX, "prepare_table must cover every command type");
+
+const ExecFunc exec_table[] = {
+	ExecNop,             //CMD_NOP
+	ExecNop,             //CMD_SET_BARRIER, resolved by PlanBarriers
+	ExecSetRenderTarget, //CMD_SET_RENDER_TARGET
+	ExecSetTexture,      //CMD_SET_TEXTURE
+	ExecUpdateTexture,   //CMD_UPDATE_TEXTURE
+	ExecSetVertex,       //CMD_SET_VERTEX
+	ExecSetIndex,        //CMD_SET_INDEX
+	ExecSetConstant,     //CMD_SET_CONSTANT
+	ExecSetShader,       //CMD_SET_SHADER
+	ExecClear,           //CMD_CLEAR
+	ExecClearDepth,      //CMD_CLEAR_DEPTH
+	ExecDrawIndex,       //CMD_DRAW_INDEX
+	ExecDrawIndexedInstanced, //CMD_DRAW_INDEXED_INSTANCED
+	ExecDrawIndirect,    //CMD_DRAW_INDIRECT
+	ExecSetComputeShader, //CMD_SET_COMPUTE_SHADER
+	ExecSetUav,          //CMD_SET_UAV
+	ExecDispatch,        //CMD_DISPATCH
+	ExecNop,             //CMD_RELEASE, applied after the frame is submitted
+	ExecNop,             //CMD_QUIT
+};
+static_assert(_countof(exec_table) == CMD_MAX, "exec_table must cover every command type");
+
+//Detaches everything the device holds for a name. The objects and descriptor slots are freed once
+//the frames that used the name have completed, and the next use of the name creates them again.
+void RetireName(GraphicsDevice & gd, uint32_t id)
+{
+	if(std::find(gd.vbackbuffer.begin(), gd.vbackbuffer.end(), id) != gd.vbackbuffer.end())
+		return;
+	for(auto variant : {gd.vdepth_pipeline[id], gd.vprepass_pipeline[id]})
+		if(variant != ~0u)
+			RetireName(gd, variant);
+	//The resource and views of a transient belong to gd.transient.
+	if(gd.vtransient[id]) {
+		gd.vtransient[id] = 0;
+		gd.vres[id] = nullptr;
+		gd.vcpu_handle[id] = InvalidHandle;
+		gd.vgpu_handle[id] = InvalidHandle;
+	}
+	pendingrelease x = {gd.vres[id], gd.vdepth[id], gd.vpstate[id], gd.vcpu_handle[id], gd.vdsv_handle[id],
+		gd.vgpu_handle[id], gd.vuav_handle[id], gd.vlast_used[id], gd.vupload[id]};
+	if(!x.res && !x.depth && !x.pstate && x.rtv == InvalidHandle && x.dsv == InvalidHandle &&
+		x.shader == InvalidHandle && x.uav == InvalidHandle)
+		return;
+	gd.vpending.push_back(x);
+	gd.vres[id] = nullptr;
+	gd.vdepth[id] = nullptr;
+	gd.vpstate[id] = nullptr;
+	gd.vcpu_handle[id] = InvalidHandle;
+	gd.vdsv_handle[id] = InvalidHandle;
+	gd.vgpu_handle[id] = InvalidHandle;
+	gd.vuav_handle[id] = InvalidHandle;
+	gd.vstate[id] = StateUnknown;
+	gd.vsplit[id] = StateUnknown;
+	gd.vupload[id] = 0;
+	gd.released_count++;
+	gd.reuse_epoch++;
+}
+
+void ReleasePending(GraphicsDevice & gd, bool is_all)
+{
+	auto & v = gd.vpending;
+	for(size_t i = 0 ; i < v.size(); ) {
+		auto & x = v[i];
+		//A direct frame that bound the placeholder, or did not sample the texture, never waited for its upload.
+		if(!is_all && (x.frame > gd.completed_frame || x.upload > gd.copy.completed)) {
+			i++;
+			continue;
+		}
+		ReleaseResource(x.res);
+		ReleaseResource(x.depth);
+		if(x.pstate)
+			x.pstate->Release();
+		if(x.rtv != InvalidHandle)
+			gd.vfree_rtv.push_back(x.rtv);
+		if(x.dsv != InvalidHandle)
+			gd.vfree_dsv.push_back(x.dsv);
+		if(x.shader != InvalidHandle)
+			gd.vfree_shader.push_back(x.shader);
+		if(x.uav != InvalidHandle)
+			gd.vfree_shader.push_back(x.uav);
+		x = v.back();
+		v.pop_back();
+	}
+}
+
+//Swaps in the pipelines the compiler finished since the last frame. The old ones are released once
+//the frames using them complete.
+void ApplyCompiledShaders(GraphicsDevice & gd)
+{
+	for(auto & x : gd.compiler.poll()) {
+		auto id = x.id;
+		auto & compile = gd.vcompile[id];
+		printf("%s : shader=%s compile=%f ms %s\n", __FUNCTION__, GetName(id), x.compile_ms, x.pstate ? "OK" : "FAILED");
+		if(x.pstate) {
+			if(gd.vpstate[id]) {
+				gd.vpending.push_back({nullptr, nullptr, gd.vpstate[id], InvalidHandle, InvalidHandle, InvalidHandle, InvalidHandle, gd.vlast_used[id], 0});
+				gd.reuse_epoch++;
+			}
+			gd.vpstate[id] = x.pstate;
+		}
+		if(compile == SHADER_RELOAD) {
+			compile = SHADER_COMPILING;
+			gd.compiler.push(x.source);
+		} else {
+			compile = x.pstate ? SHADER_IDLE : SHADER_FAILED;
+		}
+	}
+}
+
+//Stable LSD radix sort of [begin, end) by key, 8 bits a pass. A pass is skipped when every key has
+//the same digit, so the usual few distinct pipelines and textures take few passes.
+void RadixSortPackets(std::vector<drawpacket> & v, std::vector<drawpacket> & vtemp, size_t begin, size_t end)
+{
+	auto count = end - begin;
+	if(count < 2)
+		return;
+	vtemp.resize(count);
+	auto src = &v[begin];
+	auto dest = vtemp.data();
+	for(int shift = 0 ; shift < 64; shift += 8) {
+		size_t vcount[256] = {};
+		for(size_t i = 0 ; i < count; i++)
+			vcount[(src[i].key >> shift) & 0xFF]++;
+		if(vcount[(src[0].key >> shift) & 0xFF] == count)
+			continue;
+		size_t offset = 0;
+		for(auto & x : vcount) {
+			auto n = x;
+			x = offset;
+			offset += n;
+		}
+		for(size_t i = 0 ; i < count; i++)
+			dest[vcount[(src[i].key >> shift) & 0xFF]++] = src[i];
+		std::swap(src, dest);
+	}
+	if(src != &v[begin])
+		memcpy(&v[begin], src, count * sizeof(drawpacket));
+}
+
+//Indirect draws have no depth of their own and are never ordered.
+void GetDrawOrder(const cmdheader *c, float & depth, bool & is_ordered)
+{
+	depth = 0.0f;
+	is_ordered = false;
+	if(c->type == CMD_DRAW_INDEX) {
+		depth = GetPayload<draw_index_t>(c).depth;
+		is_ordered = GetPayload<draw_index_t>(c).is_ordered;
+	} else if(c->type == CMD_DRAW_INDEXED_INSTANCED) {
+		depth = GetPayload<draw_indexed_instanced_t>(c).depth;
+		is_ordered = GetPayload<draw_indexed_instanced_t>(c).is_ordered;
+	}
+}
+
+//Pipeline in the top bits, then the texture set, the vertex buffer and the quantized depth.
+uint64_t GetSortKey(const drawsorter & sorter, float depth)
+{
+	uint32_t texture = 0;
+	for(auto c : sorter.vtexture)
+		texture = texture * 31 + (c ? c->id + 1 : 0);
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+	uint64_t key = 0;
+	key |= uint64_t((sorter.shader ? sorter.shader->id + 1 : 0) & 0xFFFF) << 48;
+	key |= uint64_t(texture & 0xFFFF) << 32;
+	key |= uint64_t((sorter.vertex ? sorter.vertex->id + 1 : 0) & 0xFFFF) << 16;
+	key |= uint64_t(depth * 65535.0f);
+	return key;
+}
+
+//Appends the packets of the current run to vsorted in key order.
+void FlushDrawPackets(drawsorter & sorter)
+{
+	RadixSortPackets(sorter.vpacket, sorter.vtemp, 0, sorter.vpacket.size());
+	for(auto & packet : sorter.vpacket)
+		for(uint32_t i = 0 ; i < packet.count; i++)
+			sorter.vsorted.append(sorter.vpacketcmd[packet.begin + i]);
+	sorter.vpacket.clear();
+	sorter.vpacketcmd.clear();
+}
+
+//Groups the draws between two order dependent commands into packets that carry every binding they
+//use, and reorders the packets by sort key. Render target changes, clears, barriers, releases, shader
+//reloads, texture uploads and ordered draws stay in place. Bindings no draw uses are dropped, and
+//the ones repeated in each packet are removed again by EliminateRedundantState, so only the changes
+//between neighbouring packets are recorded. Returns the number of packets.
+uint64_t SortDraws(GraphicsDevice & gd, cmdbuffer & vcmd)
+{
+	auto & sorter = gd.sorter;
+	uint64_t packet_count = 0;
+	sorter.reset(gd.slotmax);
+	for(auto c : vcmd) {
+		switch(c->type) {
+		case CMD_NOP:
+			break;
+		case CMD_SET_SHADER:
+			//A reload is kept in place once, and the copies in later packets only bind.
+			if(GetPayload<set_shader_t>(c).is_update) {
+				FlushDrawPackets(sorter);
+				sorter.vsorted.append(c);
+				GetPayload<set_shader_t>(c).is_update = false;
+			}
+			sorter.shader = c;
+			sorter.is_compute = false;
+			break;
+		case CMD_SET_COMPUTE_SHADER:
+			//Compute bindings and dispatches stay in place.
+			FlushDrawPackets(sorter);
+			sorter.vsorted.append(c);
+			sorter.is_compute = true;
+			break;
+		case CMD_SET_VERTEX:
+			sorter.vertex = c;
+			break;
+		case CMD_SET_INDEX:
+			sorter.index = c;
+			break;
+		case CMD_SET_TEXTURE: {
+			auto & set_texture = GetPayload<set_texture_t>(c);
+			if(sorter.is_compute) {
+				sorter.vsorted.append(c);
+				break;
+			}
+			if(set_texture.data || set_texture.slot < 0 || size_t(set_texture.slot) >= sorter.vtexture.size())
+				sorter.vsorted.append(c);
+			if(set_texture.slot >= 0 && size_t(set_texture.slot) < sorter.vtexture.size())
+				sorter.vtexture[set_texture.slot] = c;
+			break;
+		}
+		case CMD_SET_CONSTANT: {
+			auto slot = GetPayload<set_constant_t>(c).slot;
+			if(sorter.is_compute)
+				sorter.vsorted.append(c);
+			else if(slot >= 0 && size_t(slot) < sorter.vconstant.size())
+				sorter.vconstant[slot] = c;
+			break;
+		}
+		case CMD_DRAW_INDEX:
+		case CMD_DRAW_INDEXED_INSTANCED:
+		case CMD_DRAW_INDIRECT: {
+			float depth = 0.0f;
+			bool is_ordered = false;
+			GetDrawOrder(c, depth, is_ordered);
+			if(is_ordered) {
+				FlushDrawPackets(sorter);
+				sorter.foreach_binding([&](const cmdheader *x) { sorter.vsorted.append(x); });
+				sorter.vsorted.append(c);
+				break;
+			}
+			drawpacket packet = {GetSortKey(sorter, depth), uint32_t(sorter.vpacketcmd.size()), 0};
+			sorter.foreach_binding([&](const cmdheader *x) { sorter.vpacketcmd.push_back(x); });
+			sorter.vpacketcmd.push_back(c);
+			packet.count = uint32_t(sorter.vpacketcmd.size()) - packet.begin;
+			sorter.vpacket.push_back(packet);
+			packet_count++;
+			break;
+		}
+		case CMD_SET_RENDER_TARGET:
+			FlushDrawPackets(sorter);
+			sorter.vsorted.append(c);
+			//Same as EliminateRedundantState, the render target can not stay bound as a texture.
+			for(auto & x : sorter.vtexture)
+				if(x && x->id == c->id)
+					x = nullptr;
+			break;
+		default:
+			FlushDrawPackets(sorter);
+			sorter.vsorted.append(c);
+			break;
+		}
+	}
+	FlushDrawPackets(sorter);
+	vcmd.swap_stream(sorter.vsorted);
+	return packet_count;
+}
+
+//Writes the pre-pass of the run, the bindings the run started with, and the run itself.
+void FlushDepthPrepass(depthprepass & pre)
+{
+	if(!pre.vprepass.empty()) {
+		for(auto x : pre.vprepass) {
+			auto c = pre.vout.append(x);
+			if(c->type == CMD_SET_SHADER) {
+				GetPayload<set_shader_t>(c).is_prepass = true;
+				GetPayload<set_shader_t>(c).is_update = false;
+			}
+		}
+		for(auto x : pre.vrestore)
+			pre.vout.append(x);
+	}
+	for(auto x : pre.vrun)
+		pre.vout.append(x);
+	pre.vrun.clear();
+	pre.vprepass.clear();
+	pre.vrestore.clear();
+	pre.foreach_binding([&](const cmdheader *x) { pre.vrestore.push_back(x); });
+}
+
+//Puts a depth only copy of the opaque draws of each run in front of the run, on render targets with
+//a depth buffer. The shading pass then only runs the pixel shader on the nearest surface. Runs end like
+//in SortDraws, and ordered draws are left out of the pre-pass. Returns the number of draws copied.
+uint64_t AddDepthPrepass(GraphicsDevice & gd, cmdbuffer & vcmd)
+{
+	auto & pre = gd.prepass;
+	uint64_t prepass_count = 0;
+	pre.reset(gd.slotmax);
+	for(auto c : vcmd) {
+		switch(c->type) {
+		case CMD_NOP:
+			break;
+		case CMD_SET_SHADER:
+			pre.shader = c;
+			pre.is_compute = false;
+			pre.vrun.push_back(c);
+			break;
+		case CMD_SET_VERTEX:
+			pre.vertex = c;
+			pre.vrun.push_back(c);
+			break;
+		case CMD_SET_INDEX:
+			pre.index = c;
+			pre.vrun.push_back(c);
+			break;
+		case CMD_SET_CONSTANT: {
+			auto slot = GetPayload<set_constant_t>(c).slot;
+			if(!pre.is_compute && slot >= 0 && size_t(slot) < pre.vconstant.size())
+				pre.vconstant[slot] = c;
+			pre.vrun.push_back(c);
+			break;
+		}
+		case CMD_SET_TEXTURE:
+			pre.vrun.push_back(c);
+			break;
+		case CMD_DRAW_INDEX:
+		case CMD_DRAW_INDEXED_INSTANCED:
+		case CMD_DRAW_INDIRECT: {
+			float depth = 0.0f;
+			bool is_ordered = false;
+			GetDrawOrder(c, depth, is_ordered);
+			if(pre.has_depth && !pre.is_compute && pre.shader && !is_ordered) {
+				pre.foreach_binding([&](const cmdheader *x) { pre.vprepass.push_back(x); });
+				pre.vprepass.push_back(c);
+				prepass_count++;
+			}
+			pre.vrun.push_back(c);
+			break;
+		}
+		case CMD_SET_RENDER_TARGET:
+			FlushDepthPrepass(pre);
+			pre.vout.append(c);
+			pre.has_depth = GetPayload<set_render_target_t>(c).has_depth;
+			break;
+		case CMD_SET_COMPUTE_SHADER:
+			FlushDepthPrepass(pre);
+			pre.vout.append(c);
+			pre.is_compute = true;
+			break;
+		default:
+			FlushDepthPrepass(pre);
+			pre.vout.append(c);
+			break;
+		}
+	}
+	FlushDepthPrepass(pre);
+	vcmd.swap_stream(pre.vout);
+	return prepass_count;
+}
+
+//Turns commands that would leave the bound state unchanged into CMD_NOP and returns how many it removed.
+uint64_t EliminateRedundantState(GraphicsDevice & gd, cmdbuffer & vcmd)
+{
+	auto & bound = gd.bound;
+	uint64_t removed = 0;
+	bound.reset(gd.slotmax);
+	for(auto c : vcmd) {
+		auto id = c->id;
+		bool redundant = false;
+		switch(c->type) {
+		case CMD_SET_RENDER_TARGET: {
+			auto & set_render_target = GetPayload<set_render_target_t>(c);
+			redundant = bound.rendertarget == id && bound.has_depth == set_render_target.has_depth &&
+				memcmp(&bound.rect, &set_render_target.rect, sizeof(rect_t)) == 0;
+			//The pipeline variant depends on the depth buffer, so the shader must be set again.
+			if(bound.has_depth != set_render_target.has_depth)
+				bound.shader = ~0u;
+			bound.rendertarget = id;
+			bound.rect = set_render_target.rect;
+			bound.has_depth = set_render_target.has_depth;
+			//A texture rendered to must be set again, so the barrier planner sees it go back to a shader resource.
+			for(auto & x : bound.vtexture)
+				if(x == id)
+					x = ~0u;
+			break;
+		}
+		case CMD_SET_SHADER:
+		case CMD_SET_COMPUTE_SHADER: {
+			//Both kinds share the pipeline but not the root arguments, so a switch forgets what was bound.
+			auto is_compute = c->type == CMD_SET_COMPUTE_SHADER;
+			if(bound.is_compute != is_compute) {
+				bound.shader = ~0u;
+				bound.vtexture.assign(gd.slotmax, ~0u);
+				bound.vconstant.assign(gd.slotmax, nullptr);
+				bound.is_compute = is_compute;
+			}
+			auto is_update = is_compute ? GetPayload<set_compute_shader_t>(c).is_update : GetPayload<set_shader_t>(c).is_update;
+			auto is_prepass = !is_compute && GetPayload<set_shader_t>(c).is_prepass;
+			redundant = bound.shader == id && bound.is_prepass == is_prepass && !is_update;
+			bound.shader = id;
+			bound.is_prepass = is_prepass;
+			break;
+		}
+		case CMD_SET_VERTEX: {
+			auto & set_vertex = GetPayload<set_vertex_t>(c);
+			redundant = bound.vertex_id == id && bound.vertex->size == set_vertex.size &&
+				bound.vertex->stride_size == set_vertex.stride_size;
+			bound.vertex_id = id;
+			bound.vertex = &set_vertex;
+			break;
+		}
+		case CMD_SET_INDEX: {
+			auto & set_index = GetPayload<set_index_t>(c);
+			redundant = bound.index_id == id && bound.index->size == set_index.size;
+			bound.index_id = id;
+			bound.index = &set_index;
+			break;
+		}
+		case CMD_SET_TEXTURE: {
+			auto slot = GetPayload<set_texture_t>(c).slot;
+			if(slot < 0 || size_t(slot) >= bound.vtexture.size())
+				break;
+			redundant = bound.vtexture[slot] == id;
+			bound.vtexture[slot] = id;
+			break;
+		}
+		case CMD_SET_CONSTANT: {
+			//Every write gets its own ring slice, so compare against the data the slot already points at.
+			auto & set_constant = GetPayload<set_constant_t>(c);
+			auto slot = set_constant.slot;
+			if(slot < 0 || size_t(slot) >= bound.vconstant.size())
+				break;
+			auto last = bound.vconstant[slot];
+			redundant = last && last->id == id && GetPayload<set_constant_t>(last).size == set_constant.size &&
+				(set_constant.size == 0 || memcmp(GetPayload<set_constant_t>(last).data, set_constant.data, set_constant.size) == 0);
+			if(!redundant)
+				bound.vconstant[slot] = c;
+			break;
+		}
+		case CMD_SET_BARRIER:
+			bound.vtexture.assign(gd.slotmax, ~0u);
+			break;
+		case CMD_SET_UAV:
+			//Like a render target, a texture written as a UAV must be set again to be read.
+			for(auto & x : bound.vtexture)
+				if(x == id)
+					x = ~0u;
+			break;
+		}
+		if(redundant) {
+			c->type = CMD_NOP;
+			removed++;
+		}
+	}
+	return removed;
+}
+
+void AddBarrier(barrierplan & plan, uint32_t id, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
+	D3D12_RESOURCE_BARRIER_FLAGS flags)
+{
+	D3D12_RESOURCE_BARRIER barrier = GetBarrier(nullptr, before, after);
+	barrier.Flags = flags;
+	plan.vbarrier.push_back(barrier);
+	plan.vid.push_back(id);
+}
+
+//A later target may get the same pointer and descriptor slots, so cached segment lists must not match.
+void ReleaseTransientTarget(GraphicsDevice & gd, transientpool::target & x)
+{
+	x.res->Release();
+	gd.vfree_rtv.push_back(x.rtv);
+	gd.vfree_shader.push_back(x.srv);
+	gd.reuse_epoch++;
+}
+
+//Drops the placed targets and the heap, and makes one of at least size bytes. The GPU must be idle.
+void GrowTransientHeap(GraphicsDevice & gd, uint64_t size)
+{
+	auto & pool = gd.transient;
+	for(auto & x : pool.vtarget)
+		ReleaseTransientTarget(gd, x);
+	pool.vtarget.clear();
+	if(pool.heap)
+		pool.heap->Release();
+	pool.heap = nullptr;
+	pool.heap_size = 0;
+	D3D12_HEAP_PROPERTIES hprop = {
+		D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
 	};
-	union {
-		struct set_barrier_t {
-			bool to_present;
-			bool to_rendertarget;
-			bool to_texture;
-		} set_barrier;
-
-		struct set_render_target_t {
-			int fmt;
-			rect_t rect;
-		} set_render_target;
-
-		struct set_texture_t {
-			int fmt;
-			int slot;
-			void *data;
-			size_t size;
-			rect_t rect;
-		} set_texture;
-
-		struct set_vertex_t {
-			void *data;
-			size_t size;
-			size_t stride_size;
-		} set_vertex;
-
-		struct set_index_t {
-			void *data;
-			size_t size;
-		} set_index;
-
-		struct set_constant_t {
-			int slot;
-			void *data;
-			size_t size;
-		} set_constant;
-
-		struct set_shader_t {
-			bool is_update;
-		} set_shader;
-		
-		struct clear_t {
-			vector4 color;
-		} clear;
-
-		struct draw_index_t {
-			int start;
-			int count;
-		} draw_index;
+	D3D12_HEAP_DESC desc = {size, hprop, 0, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES};
+	gd.dev->CreateHeap(&desc, IID_PPV_ARGS(&pool.heap));
+	if(pool.heap == nullptr) {
+		printf("%s : ERR CreateHeap size=%llu\n", __FUNCTION__, (unsigned long long)size);
+		return;
+	}
+	pool.heap_size = size;
+	gd.reuse_epoch++;
+}
+
+//Returns the index of a placed target at offset with this size that no other name used this frame.
+uint32_t AcquireTransientTarget(GraphicsDevice & gd, uint64_t offset, int w, int h, uint64_t frame)
+{
+	auto & pool = gd.transient;
+	auto dev = gd.dev;
+	for(uint32_t i = 0 ; i < pool.vtarget.size(); i++) {
+		auto & x = pool.vtarget[i];
+		if(x.offset == offset && x.w == w && x.h == h && x.frame != frame) {
+			x.frame = frame;
+			return i;
+		}
+	}
+	auto fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
+	D3D12_RESOURCE_DESC desc = {
+		D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, UINT64(w), UINT(h), 1, 1, fmt,
+		{1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
 	};
-	
-	void print() {
-		printf("cmd:name=%s:\t\t\t", name.c_str());
-		switch(type) {
-		case CMD_CLEAR:
-			printf("CMD_CLEAR :%f %f %f %f\n", clear.color.x, clear.color.y, clear.color.z, clear.color.w);
+	ID3D12Resource *res = nullptr;
+	dev->CreatePlacedResource(pool.heap, offset, &desc, D3D12_RESOURCE_STATE_RENDER_TARGET, nullptr, IID_PPV_ARGS(&res));
+	if(res == nullptr) {
+		printf("%s : ERR CreatePlacedResource offset=%llu w=%d h=%d\n", __FUNCTION__, (unsigned long long)offset, w, h);
+		return ~0u;
+	}
+
+	auto rtv = AllocDescriptor(gd.vfree_rtv, gd.handle_index_rtv);
+	auto cpu_handle = gd.heap_rtv->GetCPUDescriptorHandleForHeapStart();
+	cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * rtv;
+	D3D12_RENDER_TARGET_VIEW_DESC rtv_desc = {};
+	rtv_desc.Format = fmt;
+	rtv_desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+	dev->CreateRenderTargetView(res, &rtv_desc, cpu_handle);
+
+	auto srv = AllocDescriptor(gd.vfree_shader, gd.handle_index_shader);
+	cpu_handle = gd.heap_shader->GetCPUDescriptorHandleForHeapStart();
+	cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * srv;
+	D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = fmt;
+	srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srv_desc.Texture2D.MipLevels = 1;
+	dev->CreateShaderResourceView(res, &srv_desc, cpu_handle);
+
+	pool.vtarget.push_back({res, offset, w, h, rtv, srv, D3D12_RESOURCE_STATE_RENDER_TARGET, frame});
+	return uint32_t(pool.vtarget.size() - 1);
+}
+
+//Finds the first and last command that uses each transient render target, packs the lifetimes into
+//the transient heap first fit, and binds every transient name to a placed target for this frame.
+//A target is used from its SetTransientRenderTarget to the last clear, draw or dispatch that renders
+//to it or samples it. Runs after the stream stops changing and before PlanBarriers.
+void AssignTransients(GraphicsDevice & gd, cmdbuffer & vcmd)
+{
+	auto & pool = gd.transient;
+	auto frame = gd.frame_count + 1;
+	auto slotmax = gd.slotmax;
+
+	//Names only own their target within the frame that set them.
+	for(auto & life : pool.vlife) {
+		pool.vlife_index[life.id] = ~0u;
+		if(!gd.vtransient[life.id])
+			continue;
+		gd.vres[life.id] = nullptr;
+		gd.vcpu_handle[life.id] = InvalidHandle;
+		gd.vgpu_handle[life.id] = InvalidHandle;
+	}
+	pool.vlife.clear();
+	pool.vlife_index.resize(gd.vres.size(), ~0u);
+	pool.vbound.assign(slotmax * 2, ~0u);
+	pool.total_bytes = 0;
+	pool.peak_bytes = 0;
+
+	uint32_t index = 0;
+	uint32_t rendertarget = ~0u;
+	bool is_compute = false;
+	auto touch = [&](uint32_t id) {
+		if(id != ~0u && pool.vlife_index[id] != ~0u)
+			pool.vlife[pool.vlife_index[id]].last = index;
+	};
+	for(auto c : vcmd) {
+		auto id = c->id;
+		switch(c->type) {
+		case CMD_NOP:
+			continue;
+		case CMD_SET_RENDER_TARGET: {
+			auto & set_render_target = GetPayload<set_render_target_t>(c);
+			auto is_transient = set_render_target.is_transient &&
+				std::find(gd.vbackbuffer.begin(), gd.vbackbuffer.end(), id) == gd.vbackbuffer.end();
+			//A name switching between transient and owned render target starts over.
+			if(is_transient != bool(gd.vtransient[id]) && (gd.vres[id] || gd.vtransient[id]))
+				RetireName(gd, id);
+			gd.vtransient[id] = is_transient;
+			rendertarget = is_transient ? id : ~0u;
+			if(is_transient && pool.vlife_index[id] == ~0u) {
+				D3D12_RESOURCE_DESC desc = {
+					D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, UINT64(set_render_target.rect.w), UINT(set_render_target.rect.h), 1, 1,
+					DXGI_FORMAT_R8G8B8A8_UNORM, {1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+				};
+				auto info = gd.dev->GetResourceAllocationInfo(0, 1, &desc);
+				pool.vlife_index[id] = uint32_t(pool.vlife.size());
+				pool.vlife.push_back({id, index, index, c, set_render_target.rect.w, set_render_target.rect.h,
+					info.SizeInBytes, info.Alignment, 0, ~0u});
+				pool.total_bytes += info.SizeInBytes;
+			}
+			break;
+		}
+		case CMD_SET_SHADER:
+			is_compute = false;
+			break;
+		case CMD_SET_COMPUTE_SHADER:
+			is_compute = true;
+			break;
+		case CMD_SET_TEXTURE: {
+			auto slot = GetPayload<set_texture_t>(c).slot;
+			if(gd.vtransient[id] && pool.vlife_index[id] == ~0u) {
+				printf("%s : ERR %s is sampled before it is rendered this frame\n", __FUNCTION__, GetName(id));
+				c->type = CMD_NOP;
+				continue;
+			}
+			if(slot >= 0 && UINT(slot) < slotmax)
+				pool.vbound[slot + (is_compute ? slotmax : 0)] = gd.vtransient[id] ? id : ~0u;
+			break;
+		}
+		case CMD_DRAW_INDEX:
+		case CMD_DRAW_INDEXED_INSTANCED:
+		case CMD_DRAW_INDIRECT:
+			touch(rendertarget);
+			for(uint32_t slot = 0 ; slot < slotmax; slot++)
+				touch(pool.vbound[slot]);
+			break;
+		case CMD_DISPATCH:
+			for(uint32_t slot = slotmax ; slot < slotmax * 2; slot++)
+				touch(pool.vbound[slot]);
+			break;
+		}
+		touch(id);
+		index++;
+	}
+	if(pool.vlife.empty())
+		return;
+
+	//Lifetimes begin in stream order. Each takes the lowest offset that fits between the ones still alive.
+	pool.vactive.clear();
+	for(uint32_t i = 0 ; i < pool.vlife.size(); i++) {
+		auto & life = pool.vlife[i];
+		pool.vactive.erase(std::remove_if(pool.vactive.begin(), pool.vactive.end(),
+			[&](uint32_t x) { return pool.vlife[x].last < life.first; }), pool.vactive.end());
+		uint64_t offset = 0;
+		auto it = pool.vactive.begin();
+		for( ; it != pool.vactive.end(); ++it) {
+			auto & x = pool.vlife[*it];
+			offset = (offset + life.align - 1) & ~(life.align - 1);
+			if(offset + life.size <= x.offset)
+				break;
+			offset = std::max(offset, x.offset + x.size);
+		}
+		offset = (offset + life.align - 1) & ~(life.align - 1);
+		life.offset = offset;
+		pool.vactive.insert(it, i);
+		pool.peak_bytes = std::max(pool.peak_bytes, offset + life.size);
+	}
+
+	if(pool.peak_bytes > pool.heap_size) {
+		for(auto & ref : gd.devicebuffer)
+			WaitFence(gd, ref.fence, ref.value);
+		GrowTransientHeap(gd, pool.peak_bytes);
+	}
+
+	auto trim_frames = GetPresentOption().scratch_trim_frames;
+	for(size_t i = 0 ; i < pool.vtarget.size(); ) {
+		auto & x = pool.vtarget[i];
+		if(x.frame + trim_frames >= frame || x.frame > gd.completed_frame) {
+			i++;
+			continue;
+		}
+		ReleaseTransientTarget(gd, x);
+		x = pool.vtarget.back();
+		pool.vtarget.pop_back();
+	}
+
+	for(auto & life : pool.vlife) {
+		auto id = life.id;
+		life.target = pool.heap ? AcquireTransientTarget(gd, life.offset, life.w, life.h, frame) : ~0u;
+		//Without a heap the name gets an owned render target for this frame.
+		if(life.target == ~0u) {
+			gd.vtransient[id] = 0;
+			continue;
+		}
+		auto & x = pool.vtarget[life.target];
+		gd.vres[id] = x.res;
+		gd.vcpu_handle[id] = x.rtv;
+		gd.vgpu_handle[id] = x.srv;
+		gd.vstate[id] = x.state;
+		gd.vsplit[id] = StateUnknown;
+	}
+}
+
+//created is the state the translation creates the resource in when it does not exist yet.
+void RequireState(GraphicsDevice & gd, uint32_t id, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_STATES created)
+{
+	auto current = gd.vstate[id];
+	if(current == StateUnknown)
+		current = created;
+	if(gd.vsplit[id] != StateUnknown) {
+		AddBarrier(gd.plan, id, current, gd.vsplit[id], D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+		current = gd.vsplit[id];
+		gd.vsplit[id] = StateUnknown;
+	}
+	if(current != state) {
+		AddBarrier(gd.plan, id, current, state, D3D12_RESOURCE_BARRIER_FLAG_NONE);
+		gd.plan.vwritten[id] = 0;
+	}
+	gd.vstate[id] = state;
+}
+
+//Memory of a transient target may have held another one since it was last used.
+void AddAliasingBarrier(barrierplan & plan, uint32_t id)
+{
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+	plan.vbarrier.push_back(barrier);
+	plan.vid.push_back(id);
+}
+
+void AddUavBarrier(barrierplan & plan, uint32_t id)
+{
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	plan.vbarrier.push_back(barrier);
+	plan.vid.push_back(id);
+}
+
+D3D12_RESOURCE_STATES GetBarrierState(const set_barrier_t & set_barrier)
+{
+	if(set_barrier.to_rendertarget)
+		return D3D12_RESOURCE_STATE_RENDER_TARGET;
+	if(set_barrier.to_texture)
+		return StateShaderResource;
+	return D3D12_RESOURCE_STATE_PRESENT;
+}
+
+//Scans forward for the next state the stream needs the resource in.
+D3D12_RESOURCE_STATES FindNextState(GraphicsDevice & gd, uint32_t id, cmdbuffer::iterator it, cmdbuffer::iterator end)
+{
+	for( ; it != end; ++it) {
+		auto c = *it;
+		if(c->id != id)
+			continue;
+		if(c->type == CMD_SET_RENDER_TARGET)
+			return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		if(c->type == CMD_SET_TEXTURE)
+			return StateShaderResource;
+		if(c->type == CMD_SET_UAV)
+			return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		if(c->type == CMD_SET_BARRIER)
+			return GetBarrierState(GetPayload<set_barrier_t>(c));
+	}
+	if(std::find(gd.vbackbuffer.begin(), gd.vbackbuffer.end(), id) != gd.vbackbuffer.end())
+		return D3D12_RESOURCE_STATE_PRESENT;
+	return StateUnknown;
+}
+
+//Closes the current batch in front of the command at it. Render targets unbound since the previous
+//flush start a split transition here, and finish it where the stream next needs them.
+void CloseBatch(GraphicsDevice & gd, cmdbuffer::iterator it, cmdbuffer::iterator end)
+{
+	auto & plan = gd.plan;
+	for(auto id : plan.vreleased) {
+		if(!plan.allow_split)
 			break;
-		case CMD_SET_BARRIER:
-			printf("CMD_SET_BARRIER :");
-			printf("%d %d %d\n", set_barrier.to_present, set_barrier.to_rendertarget, set_barrier.to_texture);
+		if(gd.vstate[id] != D3D12_RESOURCE_STATE_RENDER_TARGET || gd.vsplit[id] != StateUnknown)
+			continue;
+		auto next = FindNextState(gd, id, it, end);
+		if(next == StateUnknown || next == D3D12_RESOURCE_STATE_RENDER_TARGET)
+			continue;
+		AddBarrier(plan, id, D3D12_RESOURCE_STATE_RENDER_TARGET, next, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+		gd.vsplit[id] = next;
+	}
+	plan.vreleased.clear();
+
+	uint32_t count = uint32_t(plan.vbarrier.size()) - plan.batch_begin;
+	if(count)
+		plan.vflush.push_back({it != end ? *it : nullptr, plan.batch_begin, count});
+	plan.batch_begin = uint32_t(plan.vbarrier.size());
+}
+
+//Works out every transition the stream implies from how each resource is used. Pending transitions
+//are flushed in front of the clear, draw or dispatch that needs them, and backbuffers return to present at the end.
+void PlanBarriers(GraphicsDevice & gd, cmdbuffer & vcmd)
+{
+	auto & plan = gd.plan;
+	uint32_t rendertarget = ~0u;
+	plan.clear();
+	plan.vuav.assign(gd.slotmax, ~0u);
+	plan.vwritten.assign(gd.vres.size(), 0);
+	for(auto it = vcmd.begin(); it != vcmd.end(); ++it) {
+		auto c = *it;
+		auto id = c->id;
+		switch(c->type) {
+		case CMD_SET_BARRIER: {
+			auto state = GetBarrierState(GetPayload<set_barrier_t>(c));
+			RequireState(gd, id, state, state);
+			break;
+		}
+		case CMD_SET_RENDER_TARGET: {
+			if(rendertarget != ~0u && rendertarget != id)
+				plan.vreleased.push_back(rendertarget);
+			auto life = gd.vtransient[id] ? gd.transient.vlife_index[id] : ~0u;
+			if(life != ~0u && gd.transient.vlife[life].begin == c)
+				AddAliasingBarrier(plan, id);
+			RequireState(gd, id, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			rendertarget = id;
+			break;
+		}
+		case CMD_SET_TEXTURE: {
+			auto & set_texture = GetPayload<set_texture_t>(c);
+			set_texture.is_placeholder = false;
+			if(gd.is_copy_queue) {
+				//A texture the prepare pass creates uploads with the copy list submitted this frame.
+				if(gd.vres[id] == nullptr && set_texture.data) {
+					gd.vupload[id] = gd.copy.value + 1;
+					gd.vstate[id] = D3D12_RESOURCE_STATE_COMMON;
+				}
+				if(gd.vupload[id] > gd.copy.ready && gd.placeholder) {
+					set_texture.is_placeholder = true;
+					gd.copy.placeholder_count++;
+					break;
+				}
+				gd.copy.need = std::max(gd.copy.need, gd.vupload[id]);
+			}
+			auto created = set_texture.data ? D3D12_RESOURCE_STATE_COPY_DEST : StateShaderResource;
+			RequireState(gd, id, StateShaderResource, created);
+			break;
+		}
+		case CMD_UPDATE_TEXTURE:
+			//Only textures this or an earlier frame created can be updated. The copy gets its own
+			//batch, and the texture goes back to a shader resource for the draws that still bind it.
+			if(gd.vstate[id] == StateUnknown)
+				break;
+			//An update waits for the upload, and the texture is bound as itself from here on.
+			if(gd.is_copy_queue) {
+				gd.copy.ready = std::max(gd.copy.ready, gd.vupload[id]);
+				gd.copy.need = std::max(gd.copy.need, gd.vupload[id]);
+			}
+			RequireState(gd, id, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_DEST);
+			CloseBatch(gd, it, vcmd.end());
+			RequireState(gd, id, StateShaderResource, StateShaderResource);
+			break;
+		case CMD_SET_UAV: {
+			auto slot = GetPayload<set_uav_t>(c).slot;
+			RequireState(gd, id, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			if(slot >= 0 && size_t(slot) < plan.vuav.size())
+				plan.vuav[slot] = id;
+			break;
+		}
+		case CMD_DISPATCH:
+			//UAVs still bound may have been used as something else since, and a dispatch waits for
+			//the writes of the previous one to the same UAV.
+			for(auto uav : plan.vuav) {
+				if(uav == ~0u)
+					continue;
+				RequireState(gd, uav, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				if(plan.vwritten[uav])
+					AddUavBarrier(plan, uav);
+				plan.vwritten[uav] = 0;
+			}
+			CloseBatch(gd, it, vcmd.end());
+			for(auto uav : plan.vuav)
+				if(uav != ~0u)
+					plan.vwritten[uav] = 1;
 			break;
+		case CMD_CLEAR:
+		case CMD_CLEAR_DEPTH:
+		case CMD_DRAW_INDEX:
+		case CMD_DRAW_INDEXED_INSTANCED:
+		case CMD_DRAW_INDIRECT:
+			CloseBatch(gd, it, vcmd.end());
+			break;
+		}
+	}
+	for(auto id : gd.vbackbuffer) {
+		if(gd.vstate[id] != D3D12_RESOURCE_STATE_PRESENT || gd.vsplit[id] != StateUnknown)
+			RequireState(gd, id, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	}
+	CloseBatch(gd, vcmd.end(), vcmd.end());
+	//Whichever name lands on a transient target next frame starts from the state it ends in.
+	for(auto & life : gd.transient.vlife)
+		if(life.target != ~0u)
+			gd.transient.vtarget[life.target].state = gd.vstate[life.id];
+}
+
+//Barriers of a name whose resource could not be created this frame are dropped from the batch.
+void FlushBarriers(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const barrierflush & flush)
+{
+	auto & plan = gd.plan;
+	uint32_t count = 0;
+	for(uint32_t i = flush.begin; i < flush.begin + flush.count; i++) {
+		auto barrier = plan.vbarrier[i];
+		auto res = gd.vres[plan.vid[i]];
+		if(res == nullptr)
+			continue;
+		if(barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV)
+			barrier.UAV.pResource = res;
+		else if(barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING)
+			barrier.Aliasing.pResourceAfter = res;
+		else
+			barrier.Transition.pResource = res;
+		plan.vbarrier[flush.begin + count] = barrier;
+		plan.vid[flush.begin + count] = plan.vid[i];
+		count++;
+	}
+	if(count)
+		cmdlist->ResourceBarrier(count, &plan.vbarrier[flush.begin]);
+}
+
+//Cuts the stream at every render target change. Each segment remembers the last shader, vertex,
+//index, texture, constant and UAV commands before it, so it can be recorded without the others.
+//Graphics and compute textures and constants are kept apart, in the two halves of the slot vectors.
+void SplitSegments(GraphicsDevice & gd, cmdbuffer & vcmd, bool split)
+{
+	const cmdheader *shader = nullptr;
+	const cmdheader *vertex = nullptr;
+	const cmdheader *index = nullptr;
+	std::vector<const cmdheader *> vslot_texture(gd.slotmax * 2, nullptr);
+	std::vector<const cmdheader *> vslot_constant(gd.slotmax * 2, nullptr);
+	std::vector<const cmdheader *> vslot_uav(gd.slotmax, nullptr);
+	auto & plan = gd.plan;
+	uint32_t flush = 0;
+
+	gd.vsegment.clear();
+	gd.vinherit.clear();
+	gd.vsegment.push_back({*vcmd.begin(), *vcmd.end(), 0, 0, 0});
+	for(auto c : vcmd) {
+		switch(c->type) {
 		case CMD_SET_RENDER_TARGET:
-			printf("CMD_SET_RENDER_TARGET :");
-			printf("rect.x=%d rect.x=%d rect.x=%d rect.x=%d : fmt=%d\n",
-				set_render_target.rect.x, set_render_target.rect.y, set_render_target.rect.w, set_render_target.rect.h, set_render_target.fmt);
+			if(split && c != gd.vsegment.back().begin) {
+				gd.vsegment.back().end = c;
+				segment seg = {c, *vcmd.end(), flush, uint32_t(gd.vinherit.size()), 0};
+				for(auto x : {shader, vertex, index})
+					if(x)
+						gd.vinherit.push_back(x);
+				for(auto x : vslot_texture)
+					if(x)
+						gd.vinherit.push_back(x);
+				for(auto x : vslot_constant)
+					if(x)
+						gd.vinherit.push_back(x);
+				for(auto x : vslot_uav)
+					if(x)
+						gd.vinherit.push_back(x);
+				seg.inherit_count = uint32_t(gd.vinherit.size()) - seg.inherit_begin;
+				gd.vsegment.push_back(seg);
+			}
 			break;
-		case CMD_SET_TEXTURE:
-			printf("CMD_SET_TEXTURE :");
-			printf("%d %d %d %d : slot=%d, fmt=%d, data=%p, size=%p\n",
-				set_texture.rect.x, set_texture.rect.y, set_texture.rect.w, set_texture.rect.h, set_texture.slot, set_texture.fmt, set_texture.data, set_texture.size);
+		case CMD_SET_SHADER:
+		case CMD_SET_COMPUTE_SHADER:
+			shader = c;
 			break;
 		case CMD_SET_VERTEX:
-			printf("CMD_SET_VERTEX :");
-			printf("data=%p, size=%zu\n", set_vertex.data, set_vertex.size);
+			vertex = c;
 			break;
 		case CMD_SET_INDEX:
-			printf("CMD_SET_INDEX :");
-			printf("data=%p, size=%zu\n", set_index.data, set_index.size);
-			break;
-		case CMD_SET_CONSTANT:
-			printf("CMD_SET_CONSTANT :");
-			printf("slot=%d, data=%p, size=%zu\n", set_constant.slot, set_constant.data, set_constant.size);
+			index = c;
 			break;
-		case CMD_SET_SHADER:
-			printf("CMD_SET_SHADER :");
-			printf("is_update=%d\n", set_shader.is_update);
+		case CMD_SET_TEXTURE: {
+			auto & set_texture = GetPayload<set_texture_t>(c);
+			if(set_texture.slot >= 0 && UINT(set_texture.slot) < gd.slotmax)
+				vslot_texture[set_texture.slot + (set_texture.is_compute ? gd.slotmax : 0)] = c;
 			break;
-		case CMD_DRAW_INDEX:
-			printf("CMD_DRAW_INDEX :");
-			printf("start=%d, count=%d\n", draw_index.start, draw_index.count);
+		}
+		case CMD_SET_CONSTANT: {
+			auto & set_constant = GetPayload<set_constant_t>(c);
+			if(set_constant.slot >= 0 && UINT(set_constant.slot) < gd.slotmax)
+				vslot_constant[set_constant.slot + (set_constant.is_compute ? gd.slotmax : 0)] = c;
 			break;
-		case CMD_MAX:
+		}
+		case CMD_SET_UAV: {
+			auto slot = GetPayload<set_uav_t>(c).slot;
+			if(slot >= 0 && size_t(slot) < vslot_uav.size())
+				vslot_uav[slot] = c;
 			break;
 		}
+		}
+		if(flush < plan.vflush.size() && plan.vflush[flush].at == c)
+			flush++;
 	}
-};
+}
 
-ID3D12Resource * CreateResource(std::string name, ID3D12Device *dev, int w, int h, DXGI_FORMAT fmt,
-	D3D12_RESOURCE_FLAGS flags, BOOL is_upload = FALSE, void *data = 0, size_t size = 0)
+uint64_t HashFlush(const GraphicsDevice & gd, const barrierflush & flush, uint64_t h)
 {
-	ID3D12Resource *res = nullptr;
-	D3D12_RESOURCE_DESC desc = {
-		D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, UINT64(w), UINT(h), 1, 1, fmt,
-		{1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, flags
-	};
-	D3D12_HEAP_PROPERTIES hprop = {
-		D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1,
-	};
-
-	if (is_upload) {
-		hprop.Type = D3D12_HEAP_TYPE_UPLOAD;
-		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		desc.Format = DXGI_FORMAT_UNKNOWN;
-		desc.MipLevels = 1;
-	}
-	auto state = D3D12_RESOURCE_STATE_GENERIC_READ;
-	auto hr = dev->CreateCommittedResource(
-		&hprop, D3D12_HEAP_FLAG_NONE, &desc, state, nullptr, IID_PPV_ARGS(&res));
-	if (hr)
-		printf("%s : ERR name=%s: w=%d, h=%d, flags=%08X, hr=%08X\n", __FUNCTION__, name.c_str(), w, h, flags, hr);
-	else
-		printf("%s : INFO name=%s: w=%d, h=%d, flags=%08X, hr=%08X\n", __FUNCTION__, name.c_str(), w, h, flags, hr);
-	if (res && is_upload && data) {
-		UINT8 *dest = nullptr;
-		res->Map(0, NULL, reinterpret_cast<void **>(&dest));
-		if (dest) {
-			printf("%s : INFO UPLOAD name=%s: w=%d, h=%d, data=%p, size=%p\n",
-				__FUNCTION__, name.c_str(), w, h, data, size);
-			memcpy(dest, data, size);
-			res->Unmap(0, NULL);
-		} else {
-			printf("%s : cant map\n", __FUNCTION__);
+	auto & plan = gd.plan;
+	for(uint32_t i = flush.begin; i < flush.begin + flush.count; i++) {
+		auto & barrier = plan.vbarrier[i];
+		h = HashValue(h, barrier.Type);
+		h = HashValue(h, barrier.Flags);
+		h = HashValue(h, gd.vres[plan.vid[i]]);
+		if(barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
+			h = HashValue(h, barrier.Transition.StateBefore);
+			h = HashValue(h, barrier.Transition.StateAfter);
 		}
 	}
-	return res;
+	return h;
 }
 
-D3D12_RESOURCE_BARRIER GetBarrier(ID3D12Resource *res, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+//Walks the segment like RecordSegment and hashes everything it would record. NOPs are skipped.
+uint64_t HashSegment(const GraphicsDevice & gd, const segment & seg, bool is_last)
 {
-	D3D12_RESOURCE_BARRIER barrier = {};
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = res;
-	barrier.Transition.StateBefore = before;
-	barrier.Transition.StateAfter = after;
-	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-	return barrier;
+	auto & vflush = gd.plan.vflush;
+	auto flush = seg.flush_begin;
+	uint64_t h = HashValue(0xCBF29CE484222325ull, gd.reuse_epoch);
+	h = HashValue(h, is_last);
+	for(uint32_t i = seg.inherit_begin; i < seg.inherit_begin + seg.inherit_count; i++)
+		h = HashCmd(gd, gd.vinherit[i], h);
+	for(auto it = cmdbuffer::iterator{seg.begin}; it != cmdbuffer::iterator{seg.end}; ++it) {
+		auto c = *it;
+		if(flush < vflush.size() && vflush[flush].at == c)
+			h = HashFlush(gd, vflush[flush++], h);
+		if(c->type != CMD_NOP)
+			h = HashCmd(gd, c, h);
+	}
+	if(is_last && flush < vflush.size())
+		h = HashFlush(gd, vflush[flush++], h);
+	return h ? h : 1;
 }
 
-D3D12_SHADER_BYTECODE CreateShaderFromFile(
-	std::string fstr, std::string entry, std::string profile, std::vector<uint8_t> &shader_code)
+void RecordSegment(GraphicsDevice & gd, ID3D12GraphicsCommandList *cmdlist, const segment & seg, bool is_last,
+	double *vtype_ns)
 {
-	ID3DBlob *blob = nullptr;
-	ID3DBlob *blob_err = nullptr;
-	ID3DBlob *blob_sig = nullptr;
-
-	std::vector<WCHAR> wfname;
-	UINT flags = 0;
-	for (int i = 0; i < fstr.length(); i++)
-		wfname.push_back(fstr[i]);
-	wfname.push_back(0);
-	D3DCompileFromFile(&wfname[0], NULL, D3D_COMPILE_STANDARD_FILE_INCLUDE,
-		entry.c_str(), profile.c_str(), flags, 0, &blob, &blob_err);
-	if (blob_err) {
-		printf("%s:\n%s\n", __FUNCTION__, (char *)blob_err->GetBufferPointer());
-		blob_err->Release();
+	auto & vflush = gd.plan.vflush;
+	auto flush = seg.flush_begin;
+	cmdlist->SetGraphicsRootSignature(gd.rootsig);
+	cmdlist->SetComputeRootSignature(gd.rootsig_compute);
+	cmdlist->SetDescriptorHeaps(1, &gd.heap_shader);
+	if(gd.is_bindless)
+		cmdlist->SetGraphicsRootDescriptorTable(1, gd.heap_shader->GetGPUDescriptorHandleForHeapStart());
+	for(uint32_t i = seg.inherit_begin; i < seg.inherit_begin + seg.inherit_count; i++)
+		exec_table[gd.vinherit[i]->type](gd, cmdlist, gd.vinherit[i]);
+	for(auto it = cmdbuffer::iterator{seg.begin}; it != cmdbuffer::iterator{seg.end}; ++it) {
+		auto c = *it;
+		if(flush < vflush.size() && vflush[flush].at == c)
+			FlushBarriers(gd, cmdlist, vflush[flush++]);
+		if(vtype_ns) {
+			auto start = GetMicroSeconds();
+			exec_table[c->type](gd, cmdlist, c);
+			vtype_ns[c->type] += (GetMicroSeconds() - start) * 1000.0;
+		} else {
+			exec_table[c->type](gd, cmdlist, c);
+		}
 	}
-	if (!blob && !blob_err)
-		printf("File Not found : %s\n", fstr.c_str());
-	if (!blob)
-		return {nullptr, 0};
-	shader_code.resize(blob->GetBufferSize());
-	memcpy(shader_code.data(), blob->GetBufferPointer(), blob->GetBufferSize());
-	if (blob)
-		blob->Release();
-	return {shader_code.data(), shader_code.size()};
+	if(is_last && flush < vflush.size())
+		FlushBarriers(gd, cmdlist, vflush[flush++]);
 }
 
-void PresentGraphics(std::vector<cmd> & vcmd, HWND hwnd, UINT w, UINT h, UINT num, UINT heapcount, UINT slotmax)
+void PresentGraphics(cmdbuffer & vcmd, HWND hwnd, UINT w, UINT h, UINT num, UINT heapcount, UINT slotmax,
+	framestats *stats = nullptr)
 {
-	struct DeviceBuffer {
-		ID3D12CommandAllocator *cmdalloc = nullptr;
-		ID3D12GraphicsCommandList *cmdlist = nullptr;
-		ID3D12Fence *fence = nullptr;
-		std::vector<ID3D12Resource *> vscratch;
-		uint64_t value = 0;
-	};
-	static std::vector<DeviceBuffer> devicebuffer;
-	static ID3D12Device *dev = nullptr;
-	static ID3D12CommandQueue *queue = nullptr;
-	static IDXGISwapChain3 *swapchain = nullptr;
-	static ID3D12DescriptorHeap *heap_rtv = nullptr;
-	static ID3D12DescriptorHeap *heap_dsv = nullptr;
-	static ID3D12DescriptorHeap *heap_shader = nullptr;
-	static ID3D12RootSignature *rootsig = nullptr;
-	static std::map<std::string, ID3D12Resource *> mres;
-	static std::map<std::string, ID3D12PipelineState *> mpstate;
-	static std::map<std::string, uint64_t> mcpu_handle;
-	static std::map<std::string, uint64_t> mgpu_handle;
-	static uint64_t handle_index_rtv = 0;
-	static uint64_t handle_index_dsv = 0;
-	static uint64_t handle_index_shader = 0;
-	static uint64_t deviceindex = 0;
-	static uint64_t frame_count = 0;
-
-	if(dev == nullptr) {
+	static GraphicsDevice gd;
+
+	if(gd.dev == nullptr) {
 		D3D12_COMMAND_QUEUE_DESC cqdesc = {};
 		D3D12_DESCRIPTOR_HEAP_DESC dhdesc_rtv = { D3D12_DESCRIPTOR_HEAP_TYPE_RTV, heapcount, D3D12_DESCRIPTOR_HEAP_FLAG_NONE, 0 };
 		D3D12_DESCRIPTOR_HEAP_DESC dhdesc_dsv = { D3D12_DESCRIPTOR_HEAP_TYPE_DSV, heapcount, D3D12_DESCRIPTOR_HEAP_FLAG_NONE, 0 };
 		D3D12_DESCRIPTOR_HEAP_DESC dhdesc_shader = { D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, heapcount, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE, 0 };
 
-		D3D12CreateDevice(NULL, D3D_FEATURE_LEVEL_11_1, IID_PPV_ARGS(&dev));
-		dev->CreateCommandQueue(&cqdesc, IID_PPV_ARGS(&queue));
-		dev->CreateDescriptorHeap(&dhdesc_rtv, IID_PPV_ARGS(&heap_rtv));
-		dev->CreateDescriptorHeap(&dhdesc_dsv, IID_PPV_ARGS(&heap_dsv));
-		dev->CreateDescriptorHeap(&dhdesc_shader, IID_PPV_ARGS(&heap_shader));
+		D3D12CreateDevice(NULL, D3D_FEATURE_LEVEL_11_1, IID_PPV_ARGS(&gd.dev));
+		auto dev = gd.dev;
+		dev->CreateCommandQueue(&cqdesc, IID_PPV_ARGS(&gd.queue));
+		dev->CreateDescriptorHeap(&dhdesc_rtv, IID_PPV_ARGS(&gd.heap_rtv));
+		dev->CreateDescriptorHeap(&dhdesc_dsv, IID_PPV_ARGS(&gd.heap_dsv));
+		dev->CreateDescriptorHeap(&dhdesc_shader, IID_PPV_ARGS(&gd.heap_shader));
 
 		IDXGIFactory4 *factory = nullptr;
 		IDXGISwapChain *temp = nullptr;
@@ -286,23 +3541,44 @@ void PresentGraphics(std::vector<cmd> & vcmd, HWND hwnd, UINT w, UINT h, UINT nu
 		};
 		CreateDXGIFactory1(IID_PPV_ARGS(&factory));
 		factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
-		factory->CreateSwapChain(queue, &desc, &temp);
-		temp->QueryInterface(IID_PPV_ARGS(&swapchain));
+		factory->CreateSwapChain(gd.queue, &desc, &temp);
+		temp->QueryInterface(IID_PPV_ARGS(&gd.swapchain));
 		temp->Release();
 		factory->Release();
+		gd.latency_event = gd.swapchain->GetFrameLatencyWaitableObject();
+		gd.fence_event = CreateEventEx(NULL, NULL, 0, EVENT_ALL_ACCESS);
 
-		devicebuffer.resize(num);
-		for(auto & x : devicebuffer) {
+		gd.slotmax = slotmax;
+		gd.devicebuffer.resize(num);
+		for(auto & x : gd.devicebuffer) {
 			dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&x.cmdalloc));
 			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, x.cmdalloc, nullptr, IID_PPV_ARGS(&x.cmdlist));
 			dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&x.fence));
 			x.cmdlist->Close();
 		}
+		gd.is_copy_queue = GetPresentOption().copy_queue;
+		if(gd.is_copy_queue) {
+			D3D12_COMMAND_QUEUE_DESC copy_desc = {};
+			copy_desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+			dev->CreateCommandQueue(&copy_desc, IID_PPV_ARGS(&gd.copy.queue));
+			dev->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&gd.copy.fence));
+			gd.copy.vslot.resize(num);
+			for(auto & x : gd.copy.vslot) {
+				x.value = 0;
+				dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&x.cmdalloc));
+			}
+			dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, gd.copy.vslot[0].cmdalloc, nullptr, IID_PPV_ARGS(&gd.copy.cmdlist));
+			gd.copy.cmdlist->Close();
+		}
 		
-		for(int i = 0 ; i < num; i++) {
+		for(UINT i = 0 ; i < num; i++) {
 			ID3D12Resource *res = nullptr;
-			swapchain->GetBuffer(i, IID_PPV_ARGS(&res));
-			mres["backbuffer" + std::to_string(i)] = res;
+			gd.swapchain->GetBuffer(i, IID_PPV_ARGS(&res));
+			auto id = GetNameId("backbuffer" + std::to_string(i));
+			GrowIdTables(gd);
+			gd.vres[id] = res;
+			gd.vstate[id] = D3D12_RESOURCE_STATE_PRESENT;
+			gd.vbackbuffer.push_back(id);
 		}
 
 		D3D12_ROOT_SIGNATURE_DESC root_signature_desc = {};
@@ -310,16 +3586,34 @@ void PresentGraphics(std::vector<cmd> & vcmd, HWND hwnd, UINT w, UINT h, UINT nu
 		std::vector<D3D12_DESCRIPTOR_RANGE> vdesc_range;
 		D3D12_ROOT_PARAMETER root_param = {};
 		root_param.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-		root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-		root_param.DescriptorTable.NumDescriptorRanges = 1;
 		
-		for(UINT i = 0 ; i < slotmax; i++) {
+		for(UINT i = 0 ; i < slotmax; i++)
 			vdesc_range.push_back({D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, i, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND});
-			vdesc_range.push_back({D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, i, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND});
-		}
 
-		for(auto & x : vdesc_range) {
-			root_param.DescriptorTable.pDescriptorRanges = &x;
+		//Textures are single descriptor tables, constants are root CBVs pointing into the upload ring.
+		//Bindless puts every SRV of the heap in one unbounded table (t0, space1) and the descriptor
+		//index of each texture slot in root constants (b0, space1), so a texture change is one 32-bit value.
+		gd.is_bindless = GetPresentOption().bindless;
+		D3D12_DESCRIPTOR_RANGE bindless_range = {D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT(-1), 0, 1, 0};
+		if(gd.is_bindless) {
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+			root_param.Constants = {0, 1, slotmax};
+			vroot_param.push_back(root_param);
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			root_param.DescriptorTable.NumDescriptorRanges = 1;
+			root_param.DescriptorTable.pDescriptorRanges = &bindless_range;
+			vroot_param.push_back(root_param);
+		}
+		for(UINT i = 0 ; i < slotmax; i++) {
+			if(!gd.is_bindless) {
+				root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+				root_param.DescriptorTable.NumDescriptorRanges = 1;
+				root_param.DescriptorTable.pDescriptorRanges = &vdesc_range[i];
+				vroot_param.push_back(root_param);
+			}
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+			root_param.Descriptor.ShaderRegister = i;
+			root_param.Descriptor.RegisterSpace = 0;
 			vroot_param.push_back(root_param);
 		}
 
@@ -327,7 +3621,7 @@ void PresentGraphics(std::vector<cmd> & vcmd, HWND hwnd, UINT w, UINT h, UINT nu
 		const D3D12_STATIC_SAMPLER_DESC default_sampler = {
 			D3D12_FILTER_MIN_MAG_MIP_POINT,
 			D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_WRAP,
-			0.0f, 0.0f, D3D12_COMPARISON_FUNC_NEVER, D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK, 0.0f, D3D12_FLOAT32_MAX,
+			0.0f, 0, D3D12_COMPARISON_FUNC_NEVER, D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK, 0.0f, D3D12_FLOAT32_MAX,
 			0, 0, D3D12_SHADER_VISIBILITY_ALL,
 		};
 		
@@ -353,347 +3647,339 @@ void PresentGraphics(std::vector<cmd> & vcmd, HWND hwnd, UINT w, UINT h, UINT nu
 			exit(1);
 		}
 		
-		hr = dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootsig));
+		hr = dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&gd.rootsig));
 		if(perrblob) perrblob->Release();
 		if(signature) signature->Release();
+
+		//Compute takes a texture table, a root CBV and a UAV table per slot.
+		std::vector<D3D12_DESCRIPTOR_RANGE> vuav_range;
+		for(UINT i = 0 ; i < slotmax; i++)
+			vuav_range.push_back({D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, i, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND});
+		vroot_param.clear();
+		for(UINT i = 0 ; i < slotmax; i++) {
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			root_param.DescriptorTable.NumDescriptorRanges = 1;
+			root_param.DescriptorTable.pDescriptorRanges = &vdesc_range[i];
+			vroot_param.push_back(root_param);
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+			root_param.Descriptor.ShaderRegister = i;
+			root_param.Descriptor.RegisterSpace = 0;
+			vroot_param.push_back(root_param);
+			root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+			root_param.DescriptorTable.NumDescriptorRanges = 1;
+			root_param.DescriptorTable.pDescriptorRanges = &vuav_range[i];
+			vroot_param.push_back(root_param);
+		}
+		root_signature_desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+		root_signature_desc.NumParameters = vroot_param.size();
+		root_signature_desc.pParameters = vroot_param.data();
+		perrblob = nullptr;
+		signature = nullptr;
+		hr = D3D12SerializeRootSignature(&root_signature_desc, D3D_ROOT_SIGNATURE_VERSION_1_0, &signature, &perrblob);
+		if (hr && perrblob) {
+			printf("ERR : Failed D3D12SerializeRootSignature:\n%s\n", (char *)perrblob->GetBufferPointer());
+			exit(1);
+		}
+		hr = dev->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&gd.rootsig_compute));
+		if(perrblob) perrblob->Release();
+		if(signature) signature->Release();
+
+		//Draw arguments only, so the signature needs no root signature.
+		D3D12_INDIRECT_ARGUMENT_DESC indirect_arg = {};
+		indirect_arg.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+		D3D12_COMMAND_SIGNATURE_DESC cmdsig_desc = { sizeof(D3D12_DRAW_INDEXED_ARGUMENTS), 1, &indirect_arg, 0 };
+		dev->CreateCommandSignature(&cmdsig_desc, nullptr, IID_PPV_ARGS(&gd.cmdsig_draw_indexed));
+		gd.compiler.start(std::max<UINT>(GetPresentOption().compile_threads, 1));
 	};
 	
-	if(dev->GetDeviceRemovedReason()) {
-		printf("!!!!!!!!!!!!!!!!Device Lost frame_count=%p\n", frame_count);
+	if(gd.dev->GetDeviceRemovedReason()) {
+		printf("!!!!!!!!!!!!!!!!Device Lost frame_count=%llu\n", (unsigned long long)gd.frame_count);
 		Sleep(1000);
 	}
 	
-	std::map<std::string, D3D12_RESOURCE_TRANSITION_BARRIER> mbarrier;
-	deviceindex = swapchain->GetCurrentBackBufferIndex();
+	GrowIdTables(gd);
+	gd.wait_us = 0.0;
+
+	//Recording starts once the swap chain can take another frame and at most max_frames - 1 earlier
+	//frames are still on the GPU, so the frame samples its input as late as the queue allows.
+	if(hwnd) {
+		auto max_frames = GetPresentOption().max_frames ? std::min(GetPresentOption().max_frames, num) : num;
+		if(gd.max_frames != max_frames) {
+			gd.swapchain->SetMaximumFrameLatency(max_frames);
+			gd.max_frames = max_frames;
+		}
+		auto start = GetMicroSeconds();
+		WaitForSingleObjectEx(gd.latency_event, 1000, TRUE);
+		gd.wait_us += GetMicroSeconds() - start;
+		if(gd.frame_count >= max_frames) {
+			auto retired = gd.frame_count + 1 - max_frames;
+			for(auto & x : gd.devicebuffer)
+				if(x.value <= retired)
+					WaitFence(gd, x.fence, x.value);
+			gd.completed_frame = std::max(gd.completed_frame, retired);
+		}
+	}
+	gd.deviceindex = gd.swapchain->GetCurrentBackBufferIndex();
 
-	auto & ref = devicebuffer[deviceindex];
-	if (ref.fence->GetCompletedValue() != ref.value) {
-		auto hevent = CreateEventEx(NULL, NULL, 0, EVENT_ALL_ACCESS);
-		queue->Signal(ref.fence, ref.value);
-		ref.fence->SetEventOnCompletion(ref.value, hevent);
-		WaitForSingleObject(hevent, INFINITE);
-		CloseHandle(hevent);
+	//Frames complete in submission order, so every frame up to ref.value is done after this wait.
+	auto & ref = gd.devicebuffer[gd.deviceindex];
+	WaitFence(gd, ref.fence, ref.value);
+	gd.completed_frame = std::max(gd.completed_frame, ref.value);
+	auto gpu_us = ref.value ? GetMicroSeconds() - ref.submit_us : 0.0;
+	uint64_t inflight_count = 0;
+	for(auto & x : gd.devicebuffer)
+		if(x.fence->GetCompletedValue() < x.value)
+			inflight_count++;
+	if(gd.is_copy_queue) {
+		gd.copy.completed = gd.copy.fence->GetCompletedValue();
+		gd.copy.ready = gd.copy.completed;
+		gd.copy.need = 0;
+		gd.copy.placeholder_count = 0;
 	}
+	ReleasePending(gd, false);
 	
 	for(auto & scratch : ref.vscratch)
-		scratch->Release();
+		ReleaseResource(scratch);
 	ref.vscratch.clear();
+	for(auto & staging : ref.vstaging)
+		gd.scratch.recycle(staging, gd.frame_count);
+	ref.vstaging.clear();
+	gd.scratch.trim(gd.frame_count, GetPresentOption().scratch_trim_frames);
+	ref.ring.reset();
+	ref.vcmd.clear();
 
 	if(hwnd == nullptr) {
 		auto release = [](auto & x) {
 			if(x) x->Release();
 			x = nullptr;
 		};
-		auto mrelease = [=](auto & m) {
-			for(auto & p : m) {
-				if(p.second)
-					printf("%s : release=%s\n", __FUNCTION__, p.first.c_str());
-				release(p.second);
+		auto vrelease = [=](auto & v) {
+			for(size_t id = 0; id < v.size(); id++) {
+				if(v[id])
+					printf("%s : release=%s\n", __FUNCTION__, GetName(uint32_t(id)));
+				release(v[id]);
 			}
-			m.clear();
+			v.clear();
 		};
-		for(auto & ref : devicebuffer) {
+		gd.pool.stop();
+		gd.compiler.stop();
+		for(auto & x : gd.compiler.poll())
+			release(x.pstate);
+		for(auto & ref : gd.devicebuffer)
+			WaitFence(gd, ref.fence, ref.value);
+		if(gd.copy.fence)
+			WaitFence(gd, gd.copy.fence, gd.copy.value);
+		ReleasePending(gd, true);
+		for(auto & ref : gd.devicebuffer) {
+			for(auto & x : ref.vseglist)
+				release(x);
+			for(auto & x : ref.vsegalloc)
+				release(x);
+			ReleaseResource(ref.ring.res);
+			ref.ring.res = nullptr;
 			release(ref.fence);
 			release(ref.cmdlist);
 			release(ref.cmdalloc);
 		}
-		mrelease(mres);
-		mrelease(mpstate);
-		release(rootsig);
-		release(heap_shader);
-		release(heap_dsv);
-		release(heap_rtv);
-		release(swapchain);
-		release(queue);
-		release(dev);
+		for(auto & ref : gd.devicebuffer) {
+			for(auto & staging : ref.vstaging)
+				gd.scratch.recycle(staging, gd.frame_count);
+			ref.vstaging.clear();
+		}
+		for(auto & x : gd.copy.vslot) {
+			for(auto & staging : x.vstaging)
+				gd.scratch.recycle(staging, gd.frame_count);
+			x.vstaging.clear();
+			release(x.cmdalloc);
+		}
+		release(gd.copy.cmdlist);
+		release(gd.copy.fence);
+		release(gd.copy.queue);
+		ReleaseResource(gd.placeholder);
+		gd.placeholder = nullptr;
+		gd.scratch.clear();
+		for(uint32_t id = 0 ; id < gd.vres.size(); id++)
+			if(gd.vtransient[id])
+				gd.vres[id] = nullptr;
+		for(auto & x : gd.transient.vtarget)
+			ReleaseTransientTarget(gd, x);
+		gd.transient.vtarget.clear();
+		release(gd.transient.heap);
+		for(auto res : gd.vres)
+			GetHeapManager().release(res);
+		for(auto res : gd.vdepth)
+			GetHeapManager().release(res);
+		vrelease(gd.vres);
+		vrelease(gd.vdepth);
+		GetHeapManager().report();
+		GetHeapManager().clear();
+		vrelease(gd.vpstate);
+		release(gd.cmdsig_draw_indexed);
+		release(gd.rootsig_compute);
+		release(gd.rootsig);
+		release(gd.heap_shader);
+		release(gd.heap_dsv);
+		release(gd.heap_rtv);
+		release(gd.swapchain);
+		CloseHandle(gd.latency_event);
+		CloseHandle(gd.fence_event);
+		gd.latency_event = nullptr;
+		gd.fence_event = nullptr;
+		release(gd.queue);
+		release(gd.dev);
 		return;
 	}
 
+	auto thread_count = std::max<UINT>(GetPresentOption().thread_count, 1);
+	if(gd.thread_count != thread_count) {
+		gd.pool.start(thread_count);
+		gd.thread_count = thread_count;
+	}
+
+	auto translate_start = GetMicroSeconds();
 	ref.cmdalloc->Reset();
 	ref.cmdlist->Reset(ref.cmdalloc, 0);
-	ref.cmdlist->SetGraphicsRootSignature(rootsig);
-	ref.cmdlist->SetDescriptorHeaps(1, &heap_shader);
-	for(auto & c : vcmd) {
-		auto type = c.type;
-		auto name = c.name;
-		auto res = mres[name];
-		auto pstate = mpstate[name];
-
-		//CMD_SET_BARRIER
-		if(type == CMD_SET_BARRIER) {
-			D3D12_RESOURCE_TRANSITION_BARRIER tb {};
-			tb.pResource = nullptr;
-			if(c.set_barrier.to_present) {
-				tb.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-				tb.StateAfter = D3D12_RESOURCE_STATE_COMMON;
-			}
-			if(c.set_barrier.to_texture) {
-				tb.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-				tb.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-			}
-			if(c.set_barrier.to_rendertarget) {
-				tb.StateBefore = D3D12_RESOURCE_STATE_COMMON;
-				tb.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-			}
-			mbarrier[name] = tb;
-		}
-
-		//CMD_SET_RENDER_TARGET
-		if(type == CMD_SET_RENDER_TARGET) {
-			auto x = c.set_render_target.rect.x;
-			auto y = c.set_render_target.rect.y;
-			auto w = c.set_render_target.rect.w;
-			auto h = c.set_render_target.rect.h;
-			auto cpu_handle = heap_rtv->GetCPUDescriptorHandleForHeapStart();
-			auto fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
-
-			if(res == nullptr) {
-				D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
-				res = CreateResource(name, dev, w, h, fmt, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
-				mres[name] = res;
-			}
-
-			if(mcpu_handle.count(name) == 0) {
-				auto temp = cpu_handle;
-				D3D12_RENDER_TARGET_VIEW_DESC desc = {};
-				desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-				desc.Texture2D.MipSlice = 0;
-				desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-				temp.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * handle_index_rtv;
-				dev->CreateRenderTargetView(res, &desc, temp);
-				mcpu_handle[name] = handle_index_rtv++;
-			};
-
-			if(mbarrier.count(name)) {
-				D3D12_RESOURCE_BARRIER barrier = GetBarrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
-				barrier.Transition = mbarrier[name];
-				barrier.Transition.pResource = mres[name];
-				ref.cmdlist->ResourceBarrier(1, &barrier);
-			}
-			mbarrier.erase(name);
-			
-			auto cpu_index = mcpu_handle[name];
-			cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * cpu_index;
-			D3D12_VIEWPORT viewport = { FLOAT(x), FLOAT(y), FLOAT(w), FLOAT(h), 0.0f, 1.0f };
-			D3D12_RECT rect = { x, y, w, h };
-			ref.cmdlist->RSSetViewports(1, &viewport);
-			ref.cmdlist->RSSetScissorRects(1, &rect);
-			ref.cmdlist->OMSetRenderTargets(1, &cpu_handle, FALSE, nullptr); //TODO DSV
-		}
-
-		//CMD_SET_TEXTURE
-		if(type == CMD_SET_TEXTURE) {
-			auto w = c.set_texture.rect.w;
-			auto h = c.set_texture.rect.h;
-			auto cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
-			auto gpu_handle = heap_shader->GetGPUDescriptorHandleForHeapStart();
-			auto slot = c.set_texture.slot;
-			auto fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
+	uint64_t packet_count = 0;
+	uint64_t prepass_count = 0;
+	if(GetPresentOption().sort_draws)
+		packet_count = SortDraws(gd, vcmd);
+	if(GetPresentOption().depth_prepass)
+		prepass_count = AddDepthPrepass(gd, vcmd);
+	auto removed = EliminateRedundantState(gd, vcmd);
+	auto reuse = GetPresentOption().reuse_segments;
+	gd.plan.allow_split = thread_count == 1 && !reuse;
+	if(gd.is_copy_queue && gd.placeholder == nullptr)
+		CreatePlaceholder(gd, ref);
+	AssignTransients(gd, vcmd);
+	PlanBarriers(gd, vcmd);
 
-			if(res == nullptr) {
-				D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
-				res = CreateResource(name, dev, w, h, fmt, D3D12_RESOURCE_FLAG_NONE);
-				auto scratch = CreateResource(name, dev, c.set_texture.size, 1,
-					DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, c.set_texture.data, c.set_texture.size);
-				ref.vscratch.push_back(scratch);
-				mres[name] = res;
-
-				D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-				D3D12_TEXTURE_COPY_LOCATION dest = {};
-				D3D12_TEXTURE_COPY_LOCATION src = {};
-				D3D12_RESOURCE_DESC desc_res = res->GetDesc();
-				UINT64 total_bytes = 0;
-				UINT subres_index = 0;
-
-				dev->GetCopyableFootprints(&desc_res, subres_index, 1, 0, &footprint, nullptr, nullptr, &total_bytes);
-				dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-				src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-				dest.pResource = res;
-				src.pResource = scratch;
-
-				dest.SubresourceIndex = subres_index;
-				src.PlacedFootprint = footprint;
-				ref.cmdlist->CopyTextureRegion(&dest, 0, 0, 0, &src, nullptr );
-				D3D12_RESOURCE_BARRIER barrier = GetBarrier(res, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-				ref.cmdlist->ResourceBarrier(1, &barrier);
-			}
-			if(mgpu_handle.count(name) == 0) {
-				D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
-				desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-				desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-				desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-				desc.Texture2D.MipLevels = 1;
-				cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * handle_index_shader;
-				dev->CreateShaderResourceView(res, &desc, cpu_handle);
-				mgpu_handle[name] = handle_index_shader++;
-			}
-			D3D12_RESOURCE_DESC desc_res = res->GetDesc();
-			if(mbarrier.count(name) && (desc_res.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) ) {
-				D3D12_RESOURCE_BARRIER barrier = GetBarrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
-				barrier.Transition = mbarrier[name];
-				barrier.Transition.pResource = mres[name];
-				ref.cmdlist->ResourceBarrier(1, &barrier);
-			}
-			mbarrier.erase(name);
-			auto gpu_index = mgpu_handle[name];
-			gpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gpu_index;
-			ref.cmdlist->SetGraphicsRootDescriptorTable((slot * 2) + 0, gpu_handle);
+	//Resources, descriptors and pipelines are created in order on this thread. Upload copies land
+	//in the main list ahead of every segment.
+	auto frame = gd.frame_count + 1;
+	auto profile = stats && GetPresentOption().profile;
+	ApplyCompiledShaders(gd);
+	gd.shader_ready = false;
+	gd.compute_ready = false;
+	gd.is_compute = false;
+	gd.has_depth = false;
+	gd.update_bytes = 0;
+	for(auto c : vcmd) {
+		gd.vlast_used[c->id] = frame;
+		if(profile) {
+			auto type = c->type;
+			auto start = GetMicroSeconds();
+			prepare_table[type](gd, ref, c);
+			stats->vtype_ns[type] += (GetMicroSeconds() - start) * 1000.0;
+			stats->vtype_count[type]++;
+		} else {
+			prepare_table[c->type](gd, ref, c);
 		}
+	}
+	SubmitCopies(gd);
 
-		//CMD_SET_VERTEX
-		if(type == CMD_SET_VERTEX) {
-			if(res == nullptr) {
-				res = CreateResource(name, dev, c.set_vertex.size, 1,
-					DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, c.set_vertex.data, c.set_vertex.size);
-				mres[name] = res;
+	//With reuse_segments every segment gets a list of its own, and the main list only holds the uploads.
+	SplitSegments(gd, vcmd, thread_count > 1 || reuse);
+	auto segment_count = gd.vsegment.size();
+	size_t first = reuse ? 1 : 0;
+	while(ref.vseglist.size() + 1 < segment_count + first) {
+		ID3D12CommandAllocator *cmdalloc = nullptr;
+		ID3D12GraphicsCommandList *cmdlist = nullptr;
+		gd.dev->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmdalloc));
+		gd.dev->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, cmdalloc, 0, IID_PPV_ARGS(&cmdlist));
+		cmdlist->Close();
+		ref.vsegalloc.push_back(cmdalloc);
+		ref.vseglist.push_back(cmdlist);
+		ref.vseghash.push_back(0);
+	}
+	std::vector<ID3D12CommandList *> vlist(segment_count + first);
+	std::vector<double> vsegment_ns(profile ? segment_count * CMD_MAX : 0);
+	std::atomic<uint64_t> reused {0};
+	if(reuse) {
+		ref.cmdlist->Close();
+		vlist[0] = ref.cmdlist;
+	} else {
+		std::fill(ref.vseghash.begin(), ref.vseghash.end(), 0);
+	}
+	gd.pool.run(segment_count, [&](size_t i) {
+		auto cmdlist = ref.cmdlist;
+		auto is_last = i + 1 == segment_count;
+		auto index = i + first - 1;
+		if(reuse) {
+			//The list last ran with this frame buffer, whose fence has completed, so it can run again.
+			auto hash = HashSegment(gd, gd.vsegment[i], is_last);
+			vlist[i + first] = ref.vseglist[index];
+			if(ref.vseghash[index] == hash) {
+				reused++;
+				return;
 			}
-			D3D12_VERTEX_BUFFER_VIEW view = {
-				res->GetGPUVirtualAddress(), UINT(c.set_vertex.size), UINT(c.set_vertex.stride_size)
-			};
-			ref.cmdlist->IASetVertexBuffers(0, 1, &view);
-			ref.cmdlist->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+			ref.vseghash[index] = hash;
 		}
-
-		//CMD_SET_INDEX
-		if(type == CMD_SET_INDEX) {
-			if(res == nullptr) {
-				res = CreateResource(name, dev, c.set_vertex.size, 1,
-					DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, c.set_index.data, c.set_index.size);
-				mres[name] = res;
-			}
-			D3D12_INDEX_BUFFER_VIEW view = {
-				res->GetGPUVirtualAddress(), UINT(c.set_index.size), DXGI_FORMAT_R32_UINT
-			};
-			ref.cmdlist->IASetIndexBuffer(&view);
-		}
-
-		//CMD_SET_SHADER
-		if(type == CMD_SET_SHADER) {
-			if(pstate == nullptr || c.set_shader.is_update) {
-				if(pstate)
-					pstate->Release();
-				pstate = nullptr;
-				mpstate[name] = nullptr;
-				
-				std::vector<uint8_t> vs;
-				std::vector<uint8_t> ps;
-				D3D12_GRAPHICS_PIPELINE_STATE_DESC gpstate_desc = {};
-				D3D12_INPUT_ELEMENT_DESC iedesc = {
-					"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0
-				};
-				gpstate_desc.InputLayout.pInputElementDescs = &iedesc;
-				gpstate_desc.InputLayout.NumElements = 1;
-				for(auto & bs : gpstate_desc.BlendState.RenderTarget) {
-					bs.BlendEnable = FALSE;
-					bs.LogicOpEnable = FALSE;
-					bs.SrcBlend = D3D12_BLEND_SRC_ALPHA;
-					bs.DestBlend = D3D12_BLEND_INV_DEST_ALPHA;
-					bs.BlendOp = D3D12_BLEND_OP_ADD;
-					bs.SrcBlendAlpha = D3D12_BLEND_ONE;
-					bs.DestBlendAlpha = D3D12_BLEND_ZERO;
-					bs.BlendOpAlpha = D3D12_BLEND_OP_ADD;
-					bs.LogicOp = D3D12_LOGIC_OP_XOR;
-					bs.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-				}
-				gpstate_desc.NumRenderTargets = _countof(gpstate_desc.BlendState.RenderTarget);
-				gpstate_desc.pRootSignature = rootsig;
-				gpstate_desc.VS = CreateShaderFromFile(name, "VSMain", "vs_5_0", vs);
-				gpstate_desc.PS = CreateShaderFromFile(name, "PSMain", "ps_5_0", ps);
-				gpstate_desc.SampleDesc.Count = 1;
-				gpstate_desc.SampleMask = UINT_MAX;
-				gpstate_desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-				gpstate_desc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-				gpstate_desc.RasterizerState.DepthClipEnable = TRUE;
-				gpstate_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-				
-				for(auto & fmt : gpstate_desc.RTVFormats)
-					fmt = DXGI_FORMAT_R8G8B8A8_UNORM;
-				
-				if(!vs.empty() && !ps.empty()) {
-					auto status = dev->CreateGraphicsPipelineState(&gpstate_desc, IID_PPV_ARGS(&pstate));
-					if(pstate)
-						mpstate[name] = pstate;
-					else
-						printf("Error CreateGraphicsPipelineState : %s : status=%p\n", name.c_str(), status);
-				} else {
-					printf("Compile Error %s\n", name.c_str());
-				}
-			}
-			if(pstate)
-				ref.cmdlist->SetPipelineState(pstate);
-			else
-				Sleep(500);
+		if(i + first) {
+			cmdlist = ref.vseglist[index];
+			ref.vsegalloc[index]->Reset();
+			cmdlist->Reset(ref.vsegalloc[index], 0);
 		}
+		RecordSegment(gd, cmdlist, gd.vsegment[i], is_last, profile ? &vsegment_ns[i * CMD_MAX] : nullptr);
+		cmdlist->Close();
+		vlist[i + first] = cmdlist;
+	});
+	//Only uploads this frame binds or updates are waited for, the rest keep their placeholder.
+	auto copy_wait = std::min(gd.copy.need, gd.copy.value) > gd.copy.waited;
+	if(copy_wait) {
+		gd.copy.waited = std::min(gd.copy.need, gd.copy.value);
+		gd.queue->Wait(gd.copy.fence, gd.copy.waited);
+	}
+	gd.queue->ExecuteCommandLists(UINT(vlist.size()), vlist.data());
+	for(size_t i = 0 ; i < vsegment_ns.size(); i++)
+		stats->vtype_ns[i % CMD_MAX] += vsegment_ns[i];
+	if(stats) {
+		stats->cmd_count = vcmd.size();
+		stats->removed_count = removed;
+		stats->packet_count = packet_count;
+		stats->prepass_count = prepass_count;
+		stats->reused_count = reused;
+		stats->payload_bytes = vcmd.arena.total;
+		stats->barrier_count = gd.plan.vbarrier.size();
+		stats->barrier_batches = gd.plan.vflush.size();
+		stats->segment_count = segment_count;
+		stats->constant_bytes = ref.ring.used;
+		stats->update_bytes = gd.update_bytes;
+		stats->transient_bytes = gd.transient.total_bytes;
+		stats->transient_peak = gd.transient.peak_bytes;
+		stats->placeholder_count = gd.copy.placeholder_count;
+		stats->copy_wait_count = copy_wait ? 1 : 0;
+		stats->inflight_count = inflight_count;
+		stats->wait_us = gd.wait_us;
+		stats->gpu_us = gpu_us;
+		GetHeapManager().GetUsage(stats->heap_reserved, stats->heap_used);
+		stats->scratch_hit = gd.scratch.hit_count;
+		stats->scratch_miss = gd.scratch.miss_count;
+		stats->scratch_bytes = gd.scratch.resident_bytes;
+		stats->translate_us = GetMicroSeconds() - translate_start;
+	}
+	ref.value = ++gd.frame_count;
+	ref.submit_us = GetMicroSeconds();
+	gd.queue->Signal(ref.fence, ref.value);
 
-		//CMD_CLEAR
-		if(type == CMD_CLEAR) {
-			auto cpu_handle = heap_rtv->GetCPUDescriptorHandleForHeapStart();
-			auto index = mcpu_handle[name];
-			cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV) * index;
-			ref.cmdlist->ClearRenderTargetView(cpu_handle, c.clear.color.data, 0, NULL);
-		}
+	for(auto id : gd.vrelease_id)
+		RetireName(gd, id);
+	gd.vrelease_id.clear();
+	if(auto evict_frames = GetPresentOption().evict_frames) {
+		for(uint32_t id = 0 ; id < gd.vres.size(); id++)
+			if(gd.vlast_used[id] + evict_frames < frame)
+				RetireName(gd, id);
+	}
+	if(stats)
+		stats->released_count = gd.released_count;
+	gd.swapchain->Present(1, 0);
 
-		//CMD_SET_CONSTANT
-		if(type == CMD_SET_CONSTANT) {
-			auto cpu_handle = heap_shader->GetCPUDescriptorHandleForHeapStart();
-			auto gpu_handle = heap_shader->GetGPUDescriptorHandleForHeapStart();
-			auto slot = c.set_constant.slot;
-			if(res == nullptr) {
-				res = CreateResource(name, dev, c.set_constant.size, 1,
-					DXGI_FORMAT_UNKNOWN, D3D12_RESOURCE_FLAG_NONE, TRUE, c.set_constant.data, c.set_constant.size);
-				mres[name] = res;
-			}
-			if(mgpu_handle.count(name) == 0) {
-				D3D12_CONSTANT_BUFFER_VIEW_DESC desc = {};
-				D3D12_RESOURCE_DESC desc_res = res->GetDesc();
-				desc.SizeInBytes = (desc_res.Width + 255) & ~255;
-				desc.BufferLocation = res->GetGPUVirtualAddress();
-				cpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * handle_index_shader;
-				dev->CreateConstantBufferView(&desc, cpu_handle);
-				mgpu_handle[name] = handle_index_shader++;
-			}
-			auto gpu_index = mgpu_handle[name];
-			gpu_handle.ptr += dev->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * gpu_index;
-			ref.cmdlist->SetGraphicsRootDescriptorTable((slot * 2) + 1, gpu_handle);
-			{
-				UINT8 *dest = nullptr;
-				res->Map(0, NULL, reinterpret_cast<void **>(&dest));
-				if (dest) {
-					memcpy(dest, c.set_constant.data, c.set_constant.size);
-					res->Unmap(0, NULL);
-				} else {
-					printf("%s : cant map\n", __FUNCTION__);
-				}
-			}
-		}
-		
-		//CMD_DRAW_INDEX
-		if(type == CMD_DRAW_INDEX) {
-			UINT IndexCountPerInstance = c.draw_index.count;
-			UINT InstanceCount = 1;
-			UINT StartIndexLocation = 0;
-			INT  BaseVertexLocation = 0;
-			UINT StartInstanceLocation = 0;
-			ref.cmdlist->DrawIndexedInstanced(
-				IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
-		}
-	}
-	for(auto & tb : mbarrier) {
-		D3D12_RESOURCE_BARRIER barrier = GetBarrier(nullptr, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON);
-		barrier.Transition = tb.second;
-		barrier.Transition.pResource = mres[tb.first];
-		ref.cmdlist->ResourceBarrier(1, &barrier);
-	}
-	ref.cmdlist->Close();
-	ID3D12CommandList *pplists[] = {
-		ref.cmdlist,
-	};
-	queue->ExecuteCommandLists(1, pplists);
-	swapchain->Present(1, 0);
-	ref.value = frame_count++;
+	//The frame keeps its stream and payloads until its fence completes, and the caller gets back
+	//the empty stream of the frame that just retired.
+	std::swap(ref.vcmd, vcmd);
 }
 
 
+#ifndef GCMD_REPLAY
 static LRESULT WINAPI
 MsgProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -766,140 +4052,308 @@ Update()
 	}
 	return is_active;
 }
+#endif
 
 
-void SetBarrierToPresent(std::vector<cmd> & vcmd, std::string name)
+//Transitions are inferred from SetRenderTarget, SetTexture and the end of the frame. These force
+//a resource into a state at a given point in the stream.
+void SetBarrierToPresent(cmdbuffer & vcmd, nameid name)
 {
-	cmd c;
-	c.type = CMD_SET_BARRIER;
-	c.name = name;
-	c.set_barrier.to_present = true;
-	c.set_barrier.to_rendertarget = false;
-	c.set_barrier.to_texture = false;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_barrier_t>(CMD_SET_BARRIER, name.id);
+	c.to_present = true;
+	c.to_rendertarget = false;
+	c.to_texture = false;
 }
 
-void SetBarrierToRenderTarget(std::vector<cmd> & vcmd, std::string name)
+void SetBarrierToRenderTarget(cmdbuffer & vcmd, nameid name)
 {
-	cmd c;
-	c.type = CMD_SET_BARRIER;
-	c.name = name;
-	c.set_barrier.to_present = false;
-	c.set_barrier.to_rendertarget = true;
-	c.set_barrier.to_texture = false;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_barrier_t>(CMD_SET_BARRIER, name.id);
+	c.to_present = false;
+	c.to_rendertarget = true;
+	c.to_texture = false;
 }
 
-void SetBarrierToTexture(std::vector<cmd> & vcmd, std::string name)
+void SetBarrierToTexture(cmdbuffer & vcmd, nameid name)
 {
-	cmd c;
-	c.type = CMD_SET_BARRIER;
-	c.name = name;
-	c.set_barrier.to_present = false;
-	c.set_barrier.to_rendertarget = false;
-	c.set_barrier.to_texture = true;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_barrier_t>(CMD_SET_BARRIER, name.id);
+	c.to_present = false;
+	c.to_rendertarget = false;
+	c.to_texture = true;
 }
 
-void SetRenderTarget(std::vector<cmd> & vcmd, std::string name, int w, int h)
+//Set the shader after the render target, the pipeline depends on has_depth.
+void SetRenderTarget(cmdbuffer & vcmd, nameid name, int w, int h, bool has_depth = false)
 {
-	SetBarrierToRenderTarget(vcmd, name);
+	auto & c = vcmd.push<set_render_target_t>(CMD_SET_RENDER_TARGET, name.id);
+	c.has_depth = has_depth;
+	c.is_transient = false;
+	c.fmt = 0;
+	c.rect.x = 0;
+	c.rect.y = 0;
+	c.rect.w = w;
+	c.rect.h = h;
+}
+
+//The target only lives from here to the last draw that renders to it or samples it in this frame, and
+//shares memory with transients used at other times. Clear it first, its contents are undefined.
+void SetTransientRenderTarget(cmdbuffer & vcmd, nameid name, int w, int h, bool has_depth = false)
+{
+	auto & c = vcmd.push<set_render_target_t>(CMD_SET_RENDER_TARGET, name.id);
+	c.has_depth = has_depth;
+	c.is_transient = true;
+	c.fmt = 0;
+	c.rect.x = 0;
+	c.rect.y = 0;
+	c.rect.w = w;
+	c.rect.h = h;
+}
+
+void SetTexture(cmdbuffer & vcmd, nameid name, int slot, int w = 0, int h = 0, void *data = nullptr, size_t size = 0)
+{
+	auto & c = vcmd.push<set_texture_t>(CMD_SET_TEXTURE, name.id);
+	c.fmt = 0;
+	c.slot = slot;
+	c.data = vcmd.arena.alloc(data, size);
+	c.size = size;
+	c.rect.x = 0;
+	c.rect.y = 0;
+	c.rect.w = w;
+	c.rect.h = h;
+}
+
+//data points at texel (x, y) of an R8G8B8A8 image with rows pitch bytes apart. Only the rect is copied.
+void UpdateTexture(cmdbuffer & vcmd, nameid name, int x, int y, int w, int h, const void *data, size_t pitch)
+{
+	auto & c = vcmd.push<update_texture_t>(CMD_UPDATE_TEXTURE, name.id);
+	c.rect = {x, y, w, h};
+	c.pitch = pitch;
+	c.size = w > 0 && h > 0 ? pitch * (h - 1) + w * sizeof(uint32_t) : 0;
+	c.data = vcmd.arena.alloc(data, c.size);
+	c.staging = nullptr;
+	c.offset = 0;
+	c.row_pitch = 0;
+}
+
+void SetVertex(cmdbuffer & vcmd, nameid name, void *data, size_t size, size_t stride_size)
+{
+	auto & c = vcmd.push<set_vertex_t>(CMD_SET_VERTEX, name.id);
+	c.data = vcmd.arena.alloc(data, size);
+	c.size = size;
+	c.stride_size = stride_size;
+}
+
+void SetIndex(cmdbuffer & vcmd, nameid name, void *data, size_t size)
+{
+	auto & c = vcmd.push<set_index_t>(CMD_SET_INDEX, name.id);
+	c.data = vcmd.arena.alloc(data, size);
+	c.size = size;
+}
+
+void SetConstant(cmdbuffer & vcmd, nameid name, int slot, void *data, size_t size)
+{
+	auto & c = vcmd.push<set_constant_t>(CMD_SET_CONSTANT, name.id);
+	c.slot = slot;
+	c.data = vcmd.arena.alloc(data, size);
+	c.size = size;
+}
+
+void SetShader(cmdbuffer & vcmd, nameid name, bool is_update)
+{
+	auto & c = vcmd.push<set_shader_t>(CMD_SET_SHADER, name.id);
+	c.is_update = is_update;
+}
+
+void ClearRenderTarget(cmdbuffer & vcmd, nameid name, vector4 col)
+{
+	auto & c = vcmd.push<clear_t>(CMD_CLEAR, name.id);
+	c.color = col;
+}
+
+//Clears the depth buffer of a render target set with has_depth.
+void ClearDepth(cmdbuffer & vcmd, nameid name, float depth = 1.0f)
+{
+	auto & c = vcmd.push<clear_depth_t>(CMD_CLEAR_DEPTH, name.id);
+	c.depth = depth;
+}
+
+//Frees the resource, pipeline and descriptor slots behind a name at the end of the frame.
+void Release(cmdbuffer & vcmd, nameid name)
+{
+	vcmd.push<release_t>(CMD_RELEASE, name.id);
+}
+
+void DrawIndex(cmdbuffer & vcmd, nameid name, int start, int count, float depth = 0.0f)
+{
+	auto & c = vcmd.push<draw_index_t>(CMD_DRAW_INDEX, name.id);
+	c.start = start;
+	c.count = count;
+	c.depth = depth;
+	c.is_ordered = false;
+}
 
-	cmd c;
-	c.type = CMD_SET_RENDER_TARGET;
-	c.name = name;
-	c.set_render_target.fmt = 0;
-	c.set_render_target.rect.x = 0;
-	c.set_render_target.rect.y = 0;
-	c.set_render_target.rect.w = w;
-	c.set_render_target.rect.h = h;
-	vcmd.push_back(c);
+//For draws that depend on what was drawn before them, such as blending. The sort keeps them in place.
+void DrawIndexOrdered(cmdbuffer & vcmd, nameid name, int start, int count)
+{
+	auto & c = vcmd.push<draw_index_t>(CMD_DRAW_INDEX, name.id);
+	c.start = start;
+	c.count = count;
+	c.depth = 0.0f;
+	c.is_ordered = true;
 }
 
-void SetTexture(std::vector<cmd> & vcmd, std::string name, int slot, int w = 0, int h = 0, void *data = nullptr, size_t size = 0)
+void DrawIndexedInstanced(cmdbuffer & vcmd, nameid name, int index_count, int instance_count, int start_index = 0,
+	int base_vertex = 0, int start_instance = 0, float depth = 0.0f, bool is_ordered = false)
 {
-	SetBarrierToTexture(vcmd, name);
+	auto & c = vcmd.push<draw_indexed_instanced_t>(CMD_DRAW_INDEXED_INSTANCED, name.id);
+	c.index_count = index_count;
+	c.instance_count = instance_count;
+	c.start_index = start_index;
+	c.base_vertex = base_vertex;
+	c.start_instance = start_instance;
+	c.depth = depth;
+	c.is_ordered = is_ordered;
+}
 
-	cmd c;
-	c.type = CMD_SET_TEXTURE;
-	c.name = name;
-	c.set_texture.fmt = 0;
-	c.set_texture.slot = slot;
-	c.set_texture.data = data;
-	c.set_texture.size = size;
-	c.set_texture.rect.x = 0;
-	c.set_texture.rect.y = 0;
-	c.set_texture.rect.w = w;
-	c.set_texture.rect.h = h;
-	vcmd.push_back(c);
+//Runs up to max_count draws from the D3D12_DRAW_INDEXED_ARGUMENTS in the named buffer, starting at
+//offset bytes. data fills the buffer when it is created, a draw with InstanceCount 0 is skipped.
+void DrawIndirect(cmdbuffer & vcmd, nameid name, int max_count, uint64_t offset = 0, void *data = nullptr, size_t size = 0)
+{
+	auto & c = vcmd.push<draw_indirect_t>(CMD_DRAW_INDIRECT, name.id);
+	c.data = vcmd.arena.alloc(data, size);
+	c.size = size;
+	c.offset = offset;
+	c.max_count = max_count;
 }
 
-void SetVertex(std::vector<cmd> & vcmd, std::string name, void *data, size_t size, size_t stride_size)
+//Compiles CSMain from the file. Textures, constants and UAVs set after it bind to the compute root
+//signature, until the next SetShader.
+void SetComputeShader(cmdbuffer & vcmd, nameid name, bool is_update)
 {
-	cmd c;
-	c.type = CMD_SET_VERTEX;
-	c.name = name;
-	c.set_vertex.data = data;
-	c.set_vertex.size = size;
-	c.set_vertex.stride_size = stride_size;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_compute_shader_t>(CMD_SET_COMPUTE_SHADER, name.id);
+	c.is_update = is_update;
 }
 
-void SetIndex(std::vector<cmd> & vcmd, std::string name, void *data, size_t size)
+//A RWTexture2D<float4> of w x h, created on first use.
+void SetUav(cmdbuffer & vcmd, nameid name, int slot, int w, int h)
 {
-	cmd c;
-	c.type = CMD_SET_INDEX;
-	c.name = name;
-	c.set_index.data = data;
-	c.set_index.size = size;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_uav_t>(CMD_SET_UAV, name.id);
+	c.slot = slot;
+	c.rect.x = 0;
+	c.rect.y = 0;
+	c.rect.w = w;
+	c.rect.h = h;
+	c.size = 0;
+	c.stride_size = 0;
 }
 
-void SetConstant(std::vector<cmd> & vcmd, std::string name, int slot, void *data, size_t size)
+//A RWStructuredBuffer of size bytes, created on first use.
+void SetUavBuffer(cmdbuffer & vcmd, nameid name, int slot, size_t size, size_t stride_size)
 {
-	cmd c;
-	c.type = CMD_SET_CONSTANT;
-	c.name = name;
-	c.set_constant.slot = slot;
-	c.set_constant.data = data;
-	c.set_constant.size = size;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<set_uav_t>(CMD_SET_UAV, name.id);
+	c.slot = slot;
+	c.size = size;
+	c.stride_size = stride_size;
 }
 
-void SetShader(std::vector<cmd> & vcmd, std::string name, bool is_update)
+void Dispatch(cmdbuffer & vcmd, nameid name, int x, int y, int z)
 {
-	cmd c;
-	c.type = CMD_SET_SHADER;
-	c.name = name;
-	c.set_shader.is_update = is_update;
-	vcmd.push_back(c);
+	auto & c = vcmd.push<dispatch_t>(CMD_DISPATCH, name.id);
+	c.x = x;
+	c.y = y;
+	c.z = z;
+}
+
+void DebugPrint(cmdbuffer & vcmd) {
+	for(auto c : vcmd)
+		PrintCmd(c);
 }
 
-void ClearRenderTarget(std::vector<cmd> & vcmd, std::string name, vector4 col)
+//Capture file: a captureheader, then one frame after another. A frame is a captureframe, the names
+//interned since the previous frame (uint32_t length and bytes each, padded to 8 bytes as a block), and
+//the commands exactly as in the stream, each followed by the data it points at padded to 8 bytes.
+const uint32_t CaptureMagic = 0x444d4347; //"GCMD"
+const uint32_t CaptureVersion = 8;
+
+struct captureheader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t buffer_count;
+	uint32_t heap_count;
+	uint32_t slot_max;
+	uint32_t reserved;
+};
+
+struct captureframe {
+	uint32_t name_begin;
+	uint32_t name_count;
+	uint32_t cmd_count;
+	uint32_t reserved;
+	uint64_t cmd_bytes;
+};
+
+struct capturewriter {
+	FILE *fp = nullptr;
+	uint32_t name_count = 0;
+};
+
+bool CaptureBegin(capturewriter & cap, const char *path, UINT w, UINT h, UINT num, UINT heapcount, UINT slotmax)
 {
-	cmd c;
-	c.type = CMD_CLEAR;
-	c.name = name;
-	c.clear.color = col;
-	vcmd.push_back(c);
+	cap.fp = fopen(path, "wb");
+	if(cap.fp == nullptr) {
+		printf("%s : ERR cant open %s\n", __FUNCTION__, path);
+		return false;
+	}
+	captureheader header = {CaptureMagic, CaptureVersion, w, h, num, heapcount, slotmax, 0};
+	fwrite(&header, sizeof(header), 1, cap.fp);
+	cap.name_count = 0;
+	return true;
 }
 
-void DrawIndex(std::vector<cmd> & vcmd, std::string name, int start, int count)
+void CaptureFrame(capturewriter & cap, cmdbuffer & vcmd)
 {
-	cmd c;
-	c.type = CMD_DRAW_INDEX;
-	c.name = name;
-	c.draw_index.start = start;
-	c.draw_index.count = count;
-	vcmd.push_back(c);
+	static const uint8_t pad[8] = {};
+	if(cap.fp == nullptr)
+		return;
+	captureframe frame = {cap.name_count, GetNameCount() - cap.name_count, uint32_t(vcmd.size()), 0, 0};
+	for(auto c : vcmd) {
+		size_t size = 0;
+		GetCmdData(c, size);
+		frame.cmd_bytes += c->size + ((size + 7) & ~size_t(7));
+	}
+	fwrite(&frame, sizeof(frame), 1, cap.fp);
+	size_t name_bytes = 0;
+	for(uint32_t id = frame.name_begin; id < frame.name_begin + frame.name_count; id++) {
+		auto name = GetName(id);
+		uint32_t len = uint32_t(strlen(name));
+		fwrite(&len, sizeof(len), 1, cap.fp);
+		fwrite(name, len, 1, cap.fp);
+		name_bytes += sizeof(len) + len;
+	}
+	fwrite(pad, ((name_bytes + 7) & ~size_t(7)) - name_bytes, 1, cap.fp);
+	//The render thread may have interned names since the block was sized, they go in the next frame.
+	cap.name_count = frame.name_begin + frame.name_count;
+	for(auto c : vcmd) {
+		size_t size = 0;
+		auto data = GetCmdData(c, size);
+		fwrite(c, c->size, 1, cap.fp);
+		if(data && size) {
+			fwrite(*data, size, 1, cap.fp);
+			fwrite(pad, ((size + 7) & ~size_t(7)) - size, 1, cap.fp);
+		}
+	}
 }
 
-void DebugPrint(std::vector<cmd> & vcmd) {
-	for(auto & c : vcmd)
-		c.print();
+void CaptureEnd(capturewriter & cap)
+{
+	if(cap.fp)
+		fclose(cap.fp);
+	cap.fp = nullptr;
 }
 
-int main() {
+#ifndef GCMD_REPLAY
+int main(int argc, char *argv[]) {
 	enum {
 		Width = 1280,
 		Height = 720,
@@ -917,6 +4371,32 @@ int main() {
 		0, 1, 2,
 		2, 1, 3,
 	};
+	capturewriter cap;
+	for(int i = 1 ; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "-capture" && i + 1 < argc)
+			CaptureBegin(cap, argv[++i], Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+		if(arg == "-threads" && i + 1 < argc)
+			GetPresentOption().thread_count = UINT(atoi(argv[++i]));
+		if(arg == "-evict" && i + 1 < argc)
+			GetPresentOption().evict_frames = uint64_t(atoi(argv[++i]));
+		if(arg == "-scratch-trim" && i + 1 < argc)
+			GetPresentOption().scratch_trim_frames = uint64_t(atoi(argv[++i]));
+		if(arg == "-sort")
+			GetPresentOption().sort_draws = true;
+		if(arg == "-prepass")
+			GetPresentOption().depth_prepass = true;
+		if(arg == "-queue" && i + 1 < argc)
+			GetPresentOption().queue_depth = UINT(atoi(argv[++i]));
+		if(arg == "-reuse")
+			GetPresentOption().reuse_segments = true;
+		if(arg == "-bindless")
+			GetPresentOption().bindless = true;
+		if(arg == "-copy-queue")
+			GetPresentOption().copy_queue = true;
+		if(arg == "-max-frames" && i + 1 < argc)
+			GetPresentOption().max_frames = UINT(atoi(argv[++i]));
+	}
 	auto hwnd = InitWindow("test", Width, Height);
 	int index = 0;
 	static std::vector<uint32_t> vtex;
@@ -926,17 +4406,44 @@ int main() {
 		}
 	}
 
+	static std::vector<uint32_t> vblock(16 * 16, 0xFF00FFFF);
+
 	struct constdata {
 		vector4 color;
 		vector4 misc;
 	};
 	constdata cdata;
 
-	std::vector<cmd> vcmd;
+	cmdbuffer vcmd;
 
 	SetTexture(vcmd, "testtex", 0, 256, 256, vtex.data(), vtex.size() * sizeof(uint32_t));
 	uint64_t frame = 0;
-	auto beforeoffscreenname = "offscreen" + std::to_string(1);
+	uint32_t backbufferid[BufferMax];
+	uint32_t offscreenid[BufferMax];
+	uint32_t constantid[BufferMax];
+	for(int i = 0 ; i < BufferMax; i++) {
+		auto indexname = std::to_string(i);
+		backbufferid[i] = GetNameId("backbuffer" + indexname);
+		offscreenid[i] = GetNameId("offscreen" + indexname);
+		constantid[i] = GetNameId("testconstant" + indexname);
+	}
+	auto beforeoffscreenname = offscreenid[1];
+
+	//Runs on the render thread with -queue, in the loop below otherwise.
+	uint64_t present_frame = 0;
+	auto present = [&](cmdbuffer & vcmd) {
+		framestats stats;
+		auto start = GetMicroSeconds();
+		PresentGraphics(vcmd, hwnd, Width, Height, BufferMax, ResourceMax, ShaderSlotMax, &stats);
+		printf("Frame=%llu cmd=%llu removed=%llu packet=%llu prepass=%llu payload=%llu bytes barrier=%llu/%llu batches segment=%llu reused=%llu constant=%llu bytes update=%llu bytes placeholder=%llu copywait=%llu transient=%llu/%llu bytes heap=%llu/%llu bytes scratch=%llu/%llu hit/miss %llu bytes released=%llu inflight=%llu wait=%f us gpu=%f us translate=%f us present=%f us ==========\n",
+			present_frame, stats.cmd_count, stats.removed_count, stats.packet_count, stats.prepass_count, stats.payload_bytes, stats.barrier_count, stats.barrier_batches,
+			stats.segment_count, stats.reused_count, stats.constant_bytes, stats.update_bytes, stats.placeholder_count, stats.copy_wait_count, stats.transient_peak, stats.transient_bytes, stats.heap_used, stats.heap_reserved,
+			stats.scratch_hit, stats.scratch_miss, stats.scratch_bytes, stats.released_count, stats.inflight_count, stats.wait_us, stats.gpu_us, stats.translate_us, GetMicroSeconds() - start);
+		present_frame++;
+	};
+	framequeue queue;
+	if(GetPresentOption().queue_depth)
+		queue.start(GetPresentOption().queue_depth, present);
 	while(Update()) {
 		bool is_update = false;
 		if(GetAsyncKeyState(VK_F5) & 0x0001) {
@@ -952,12 +4459,14 @@ int main() {
 		cdata.misc.data[2] = 1.0;
 		cdata.misc.data[3] = 1.0;
 		
-		auto indexname = std::to_string(buffer_index);
-		auto backbuffername = "backbuffer" + indexname;
-		auto offscreenname = "offscreen" + indexname;
-		auto constantname = "testconstant" + indexname;
-		SetRenderTarget(vcmd, offscreenname, Width, Height);
+		auto backbuffername = backbufferid[buffer_index];
+		auto offscreenname = offscreenid[buffer_index];
+		auto constantname = constantid[buffer_index];
+		//Moves a small block across testtex, only its texels are uploaded.
+		UpdateTexture(vcmd, "testtex", int(frame * 4 % 256), 120, 16, 16, vblock.data(), 16 * sizeof(uint32_t));
+		SetRenderTarget(vcmd, offscreenname, Width, Height, true);
 		ClearRenderTarget(vcmd, offscreenname, {1, float(index & 1), 0, 1});
+		ClearDepth(vcmd, offscreenname);
 		if(frame >= 1) {
 			SetTexture(vcmd, beforeoffscreenname, 1);
 		}
@@ -967,23 +4476,42 @@ int main() {
 		SetIndex(vcmd, "testindex", idx, sizeof(idx));
 		SetConstant(vcmd, constantname, 0, &cdata, sizeof(cdata));
 		DrawIndex(vcmd, "offscreendraw", 0, _countof(idx));
-		
+
+		//Post passes into transient targets, post2 lands in the memory of post0.
+		const char *vpost[] = {"post0", "post1", "post2"};
+		nameid source = offscreenname;
+		for(auto post : vpost) {
+			SetTransientRenderTarget(vcmd, post, Width, Height);
+			ClearRenderTarget(vcmd, post, {0, 0, 0, 1});
+			SetShader(vcmd, "present.hlsl", is_update);
+			SetTexture(vcmd, source, 0);
+			SetConstant(vcmd, constantname, 0, &cdata, sizeof(cdata));
+			DrawIndex(vcmd, "postdraw", 0, _countof(idx));
+			source = post;
+		}
+
 		SetRenderTarget(vcmd, backbuffername, Width, Height);
 		ClearRenderTarget(vcmd, backbuffername, {1, float(index & 1), 0, 1});
 		SetShader(vcmd, "present.hlsl", is_update);
-		SetTexture(vcmd, offscreenname, 0, 0, 0, nullptr, 0);
+		SetTexture(vcmd, source, 0, 0, 0, nullptr, 0);
 		SetVertex(vcmd, "testvertex", vtx, sizeof(vtx), sizeof(vector4));
 		SetIndex(vcmd, "testindex", idx, sizeof(idx));
 		SetConstant(vcmd, constantname, 0, &cdata, sizeof(cdata));
 		DrawIndex(vcmd, "presentdraw", 0, _countof(idx));
-		SetBarrierToPresent(vcmd, backbuffername);
-		PresentGraphics(vcmd, hwnd, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
-		beforeoffscreenname = offscreenname;
 		DebugPrint(vcmd);
-		vcmd.clear();
-		printf("Frame=%d ========================================\n", frame);
+		CaptureFrame(cap, vcmd);
+		if(GetPresentOption().queue_depth)
+			queue.publish(vcmd);
+		else
+			present(vcmd);
+		beforeoffscreenname = offscreenname;
 		frame++;
 	}
+	queue.stop();
+	if(GetPresentOption().queue_depth)
+		printf("framequeue : depth=%u waited %llu of %llu frames, %f us\n", GetPresentOption().queue_depth, queue.wait_count, frame, queue.wait_us);
+	CaptureEnd(cap);
 	PresentGraphics(vcmd, nullptr, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
 	return 0;
 }
+#endif
@@ -0,0 +1,560 @@
+//CPU reference backend. Executes a GCMD frame without any device : clears, indexed triangle draws with
+//the quad vertex layout, point and linear sampling and constants, rasterized in tiles on a workerpool.
+//Shaders are C++ callables registered under the name of the .hlsl file they stand in for.
+//Include it after gcmd.cpp. Compute, UAVs and barriers are not executed.
+#include <math.h>
+
+enum {
+	SAMPLER_POINT,  //s0
+	SAMPLER_LINEAR, //s1
+};
+
+//R8G8B8A8 texels, and a D32 depth buffer for render targets set with has_depth.
+struct cpuimage {
+	int w = 0, h = 0;
+	std::vector<uint32_t> vtexel;
+	std::vector<float> vdepth;
+};
+
+//What a shader sees : the textures and constants bound to each slot.
+struct cpucontext {
+	const cpuimage * const *vtexture;
+	const std::vector<uint8_t> *vconstant;
+	int slotmax;
+
+	//Wrap addressing and mip 0, like the static samplers of the root signature.
+	vector4 Sample(int slot, int sampler, float u, float v) const
+	{
+		vector4 ret = {};
+		auto tex = slot >= 0 && slot < slotmax ? vtexture[slot] : nullptr;
+		if(tex == nullptr || tex->vtexel.empty())
+			return ret;
+		auto w = tex->w;
+		auto h = tex->h;
+		auto wrap = [](int x, int size) {
+			if(x >= 0 && x < size)
+				return x;
+			x %= size;
+			return x < 0 ? x + size : x;
+		};
+		auto floor_int = [](float x) {
+			auto i = int(x);
+			return x < float(i) ? i - 1 : i;
+		};
+		auto texel = [&](int x, int y) {
+			const float scale = 1.0f / 255.0f;
+			auto c = tex->vtexel[size_t(y) * w + x];
+			return vector4 {float(c & 0xFF) * scale, float((c >> 8) & 0xFF) * scale,
+				float((c >> 16) & 0xFF) * scale, float(c >> 24) * scale};
+		};
+		auto x = u * w;
+		auto y = v * h;
+		if(sampler == SAMPLER_POINT)
+			return texel(wrap(floor_int(x), w), wrap(floor_int(y), h));
+		x -= 0.5f;
+		y -= 0.5f;
+		auto ix = floor_int(x);
+		auto iy = floor_int(y);
+		auto fx = x - float(ix);
+		auto fy = y - float(iy);
+		auto x0 = wrap(ix, w);
+		auto y0 = wrap(iy, h);
+		auto x1 = x0 + 1 < w ? x0 + 1 : 0;
+		auto y1 = y0 + 1 < h ? y0 + 1 : 0;
+		auto t00 = texel(x0, y0);
+		auto t10 = texel(x1, y0);
+		auto t01 = texel(x0, y1);
+		auto t11 = texel(x1, y1);
+		for(int i = 0 ; i < 4; i++) {
+			auto top = t00.data[i] + (t10.data[i] - t00.data[i]) * fx;
+			auto bottom = t01.data[i] + (t11.data[i] - t01.data[i]) * fx;
+			ret.data[i] = top + (bottom - top) * fy;
+		}
+		return ret;
+	}
+
+	//Zeros past the data the stream set, like the unused part of a constant buffer view.
+	template<typename T>
+	T Constant(int slot) const
+	{
+		T ret = {};
+		if(slot >= 0 && slot < slotmax)
+			memcpy(&ret, vconstant[slot].data(), std::min(sizeof(T), vconstant[slot].size()));
+		return ret;
+	}
+};
+
+//vs returns the clip space position and writes the one float4 varying, TEXCOORD0 of the HLSL shaders.
+//ps returns the color written to the render target.
+struct cpushader {
+	std::function<vector4(const vector4 & position, int instance, const cpucontext & ctx, vector4 & varying)> vs;
+	std::function<vector4(const vector4 & varying, const cpucontext & ctx)> ps;
+};
+
+std::vector<cpushader> & GetCpuShaders()
+{
+	static std::vector<cpushader> vshader;
+	return vshader;
+}
+
+void RegisterCpuShader(nameid name, const cpushader & shader)
+{
+	auto & v = GetCpuShaders();
+	if(v.size() <= name.id)
+		v.resize(name.id + 1);
+	v[name.id] = shader;
+}
+
+struct cpustats {
+	uint64_t draw_count = 0;
+	uint64_t triangle_count = 0;
+	uint64_t pixel_count = 0;   //Pixels that passed the depth test and ran the pixel shader.
+	uint64_t skipped_count = 0; //Commands the backend does not execute, and draws without a registered shader.
+	uint64_t hazard_count = 0;  //Draws sampling the render target they draw to.
+	double execute_us = 0.0;
+};
+
+struct cpudevice {
+	static const int TileSize = 64;
+	struct triangle {
+		float a[3], b[3], c[3]; //Edge functions a * x + b * y + c, positive inside.
+		float inv_area;
+		float z[3];
+		float inv_w[3];
+		vector4 varying[3]; //Divided by w.
+		int x0, y0, x1, y1;
+	};
+	std::vector<cpuimage> vimage; //Textures and render targets, by name id.
+	std::vector<std::vector<vector4>> vvertex;
+	std::vector<std::vector<uint32_t>> vindex;
+	std::vector<std::vector<D3D12_DRAW_INDEXED_ARGUMENTS>> vargs;
+	std::vector<std::vector<uint8_t>> vconstant; //Per slot.
+	std::vector<const cpuimage *> vtexture;      //Per slot.
+	std::vector<uint32_t> vtexture_id;
+	std::vector<triangle> vtriangle;
+	workerpool pool;
+	UINT thread_count = 0;
+	int slotmax = 0;
+	uint32_t rendertarget = ~0u;
+	uint32_t shader = ~0u;
+	uint32_t vertex = ~0u;
+	uint32_t index = ~0u;
+	rect_t rect = {};
+	bool has_depth = false;
+	bool is_compute = false;
+	cpustats stats;
+
+	void init(int slot_count, UINT threads)
+	{
+		slotmax = slot_count;
+		vconstant.assign(slotmax, {});
+		vtexture.assign(slotmax, nullptr);
+		vtexture_id.assign(slotmax, ~0u);
+		threads = std::max<UINT>(threads, 1);
+		if(thread_count != threads) {
+			pool.start(threads);
+			thread_count = threads;
+		}
+	}
+
+	void grow()
+	{
+		auto namecount = GetNameCount();
+		if(vimage.size() < namecount) {
+			vimage.resize(namecount);
+			vvertex.resize(namecount);
+			vindex.resize(namecount);
+			vargs.resize(namecount);
+		}
+	}
+};
+
+uint32_t PackColor(const vector4 & color)
+{
+	uint32_t ret = 0;
+	for(int i = 0 ; i < 4; i++) {
+		auto x = std::min(std::max(color.data[i], 0.0f), 1.0f);
+		ret |= uint32_t(x * 255.0f + 0.5f) << (i * 8);
+	}
+	return ret;
+}
+
+//Runs the vertex shader on the draw's vertices and sets up the triangles in render target pixels.
+//Triangles with a vertex behind the eye are dropped instead of clipped.
+void SetupTriangles(cpudevice & cpu, const cpushader & shader, const cpucontext & ctx, int index_count,
+	int start_index, int base_vertex, int instance)
+{
+	auto & vindex = cpu.vindex[cpu.index];
+	auto & vvertex = cpu.vvertex[cpu.vertex];
+	auto & target = cpu.vimage[cpu.rendertarget];
+	auto & rect = cpu.rect;
+	auto x_min = std::max(rect.x, 0);
+	auto y_min = std::max(rect.y, 0);
+	auto x_max = std::min(rect.x + rect.w, target.w);
+	auto y_max = std::min(rect.y + rect.h, target.h);
+	for(int i = 0 ; i + 2 < index_count; i += 3) {
+		cpudevice::triangle tri = {};
+		float sx[3], sy[3];
+		bool is_valid = true;
+		for(int k = 0 ; k < 3; k++) {
+			auto n = size_t(start_index) + i + k;
+			auto v = n < vindex.size() ? int64_t(vindex[n]) + base_vertex : -1;
+			if(v < 0 || v >= int64_t(vvertex.size())) {
+				is_valid = false;
+				break;
+			}
+			vector4 varying = {};
+			auto pos = shader.vs(vvertex[v], instance, ctx, varying);
+			if(pos.w <= 0.0f) {
+				is_valid = false;
+				break;
+			}
+			auto inv_w = 1.0f / pos.w;
+			sx[k] = rect.x + (pos.x * inv_w * 0.5f + 0.5f) * rect.w;
+			sy[k] = rect.y + (0.5f - pos.y * inv_w * 0.5f) * rect.h;
+			tri.z[k] = pos.z * inv_w;
+			tri.inv_w[k] = inv_w;
+			for(int j = 0 ; j < 4; j++)
+				tri.varying[k].data[j] = varying.data[j] * inv_w;
+		}
+		if(!is_valid)
+			continue;
+		auto area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+		if(area == 0.0f)
+			continue;
+		//No culling. Both windings get the edge functions of the positive one.
+		auto sign = area > 0.0f ? 1.0f : -1.0f;
+		tri.inv_area = sign / area;
+		for(int k = 0 ; k < 3; k++) {
+			auto p = (k + 1) % 3;
+			auto q = (k + 2) % 3;
+			tri.a[k] = sign * (sy[p] - sy[q]);
+			tri.b[k] = sign * (sx[q] - sx[p]);
+			tri.c[k] = sign * (sx[p] * sy[q] - sx[q] * sy[p]);
+		}
+		tri.x0 = std::max(x_min, int(floorf(std::min({sx[0], sx[1], sx[2]}))));
+		tri.y0 = std::max(y_min, int(floorf(std::min({sy[0], sy[1], sy[2]}))));
+		tri.x1 = std::min(x_max, int(ceilf(std::max({sx[0], sx[1], sx[2]}))) + 1);
+		tri.y1 = std::min(y_max, int(ceilf(std::max({sy[0], sy[1], sy[2]}))) + 1);
+		if(tri.x0 >= tri.x1 || tri.y0 >= tri.y1)
+			continue;
+		cpu.vtriangle.push_back(tri);
+	}
+}
+
+//Shades the pixel centers of one tile that the triangles cover, in triangle order. Edges through a
+//pixel center belong to the triangle on their top or left side, so shared edges are drawn once.
+uint64_t RasterizeTile(cpudevice & cpu, const cpushader & shader, const cpucontext & ctx, int tx, int ty)
+{
+	auto & target = cpu.vimage[cpu.rendertarget];
+	auto is_depth = cpu.has_depth && !target.vdepth.empty();
+	uint64_t pixel_count = 0;
+	for(auto & tri : cpu.vtriangle) {
+		auto x0 = std::max(tri.x0, tx);
+		auto y0 = std::max(tri.y0, ty);
+		auto x1 = std::min(tri.x1, tx + cpudevice::TileSize);
+		auto y1 = std::min(tri.y1, ty + cpudevice::TileSize);
+		bool vtop_left[3];
+		for(int k = 0 ; k < 3; k++)
+			vtop_left[k] = tri.b[k] < 0.0f || (tri.b[k] == 0.0f && tri.a[k] > 0.0f);
+		for(int y = y0 ; y < y1; y++) {
+			auto py = y + 0.5f;
+			for(int x = x0 ; x < x1; x++) {
+				auto px = x + 0.5f;
+				float e[3];
+				bool is_inside = true;
+				for(int k = 0 ; k < 3; k++) {
+					e[k] = tri.a[k] * px + tri.b[k] * py + tri.c[k];
+					if(e[k] < 0.0f || (e[k] == 0.0f && !vtop_left[k]))
+						is_inside = false;
+				}
+				if(!is_inside)
+					continue;
+				float l[3] = {e[0] * tri.inv_area, e[1] * tri.inv_area, e[2] * tri.inv_area};
+				auto z = l[0] * tri.z[0] + l[1] * tri.z[1] + l[2] * tri.z[2];
+				if(z < 0.0f || z > 1.0f)
+					continue;
+				auto pixel = size_t(y) * target.w + x;
+				if(is_depth) {
+					if(z > target.vdepth[pixel])
+						continue;
+					target.vdepth[pixel] = z;
+				}
+				auto w = 1.0f / (l[0] * tri.inv_w[0] + l[1] * tri.inv_w[1] + l[2] * tri.inv_w[2]);
+				vector4 varying = {};
+				for(int j = 0 ; j < 4; j++)
+					varying.data[j] = (l[0] * tri.varying[0].data[j] + l[1] * tri.varying[1].data[j] +
+						l[2] * tri.varying[2].data[j]) * w;
+				target.vtexel[pixel] = PackColor(shader.ps(varying, ctx));
+				pixel_count++;
+			}
+		}
+	}
+	return pixel_count;
+}
+
+void DrawCpu(cpudevice & cpu, int index_count, int instance_count, int start_index, int base_vertex, int start_instance)
+{
+	auto & vshader = GetCpuShaders();
+	auto is_bound = cpu.rendertarget != ~0u && cpu.vertex != ~0u && cpu.index != ~0u && cpu.shader != ~0u;
+	if(!is_bound || cpu.shader >= vshader.size() || !vshader[cpu.shader].vs || !vshader[cpu.shader].ps) {
+		cpu.stats.skipped_count++;
+		return;
+	}
+	auto & shader = vshader[cpu.shader];
+	auto & target = cpu.vimage[cpu.rendertarget];
+	for(auto id : cpu.vtexture_id)
+		if(id == cpu.rendertarget)
+			cpu.stats.hazard_count++;
+	cpucontext ctx = {cpu.vtexture.data(), cpu.vconstant.data(), cpu.slotmax};
+	cpu.vtriangle.clear();
+	for(int i = 0 ; i < instance_count; i++)
+		SetupTriangles(cpu, shader, ctx, index_count, start_index, base_vertex, start_instance + i);
+	cpu.stats.draw_count++;
+	cpu.stats.triangle_count += cpu.vtriangle.size();
+	if(cpu.vtriangle.empty())
+		return;
+
+	auto tile_w = (target.w + cpudevice::TileSize - 1) / cpudevice::TileSize;
+	auto tile_h = (target.h + cpudevice::TileSize - 1) / cpudevice::TileSize;
+	std::atomic<uint64_t> pixel_count {0};
+	cpu.pool.run(size_t(tile_w) * tile_h, [&](size_t i) {
+		auto tx = int(i % tile_w) * cpudevice::TileSize;
+		auto ty = int(i / tile_w) * cpudevice::TileSize;
+		pixel_count += RasterizeTile(cpu, shader, ctx, tx, ty);
+	});
+	cpu.stats.pixel_count += pixel_count;
+}
+
+//Executes vcmd in stream order. Images, vertex, index and argument buffers persist across frames like
+//the device objects of PresentGraphics, so buffers keep the data of the command that created them.
+void ExecuteCpuFrame(cpudevice & cpu, cmdbuffer & vcmd)
+{
+	auto start = GetMicroSeconds();
+	cpu.grow();
+	//Bindings start empty every frame, like a command list after Reset.
+	cpu.rendertarget = ~0u;
+	cpu.shader = ~0u;
+	cpu.vertex = ~0u;
+	cpu.index = ~0u;
+	cpu.has_depth = false;
+	cpu.is_compute = false;
+	cpu.vconstant.assign(cpu.slotmax, {});
+	cpu.vtexture.assign(cpu.slotmax, nullptr);
+	cpu.vtexture_id.assign(cpu.slotmax, ~0u);
+	for(auto c : vcmd) {
+		auto id = c->id;
+		switch(c->type) {
+		case CMD_NOP:
+		case CMD_SET_BARRIER:
+		case CMD_RELEASE:
+		case CMD_QUIT:
+			break;
+		case CMD_SET_RENDER_TARGET: {
+			auto & set_render_target = GetPayload<set_render_target_t>(c);
+			auto & image = cpu.vimage[id];
+			auto & rect = set_render_target.rect;
+			if(image.vtexel.empty()) {
+				image.w = rect.w;
+				image.h = rect.h;
+				image.vtexel.assign(size_t(rect.w) * rect.h, 0);
+			}
+			if(set_render_target.has_depth && image.vdepth.empty())
+				image.vdepth.assign(image.vtexel.size(), 1.0f);
+			cpu.rendertarget = id;
+			cpu.rect = rect;
+			cpu.has_depth = set_render_target.has_depth;
+			break;
+		}
+		case CMD_SET_TEXTURE: {
+			auto & set_texture = GetPayload<set_texture_t>(c);
+			auto & image = cpu.vimage[id];
+			auto & rect = set_texture.rect;
+			auto count = size_t(std::max(rect.w, 0)) * std::max(rect.h, 0);
+			if(image.vtexel.empty() && set_texture.data && set_texture.size >= count * sizeof(uint32_t)) {
+				image.w = rect.w;
+				image.h = rect.h;
+				image.vtexel.assign((const uint32_t *)set_texture.data, (const uint32_t *)set_texture.data + count);
+			}
+			if(cpu.is_compute || set_texture.slot < 0 || set_texture.slot >= cpu.slotmax)
+				break;
+			cpu.vtexture[set_texture.slot] = &image;
+			cpu.vtexture_id[set_texture.slot] = id;
+			break;
+		}
+		case CMD_UPDATE_TEXTURE: {
+			auto & update_texture = GetPayload<update_texture_t>(c);
+			auto & image = cpu.vimage[id];
+			auto & rect = update_texture.rect;
+			if(update_texture.data == nullptr)
+				break;
+			auto x0 = std::max(rect.x, 0);
+			auto x1 = std::min(rect.x + rect.w, image.w);
+			for(int y = std::max(rect.y, 0) ; y < std::min(rect.y + rect.h, image.h) && x0 < x1; y++) {
+				auto src = (const uint8_t *)update_texture.data + size_t(y - rect.y) * update_texture.pitch + size_t(x0 - rect.x) * sizeof(uint32_t);
+				memcpy(&image.vtexel[size_t(y) * image.w + x0], src, size_t(x1 - x0) * sizeof(uint32_t));
+			}
+			break;
+		}
+		case CMD_SET_VERTEX: {
+			auto & set_vertex = GetPayload<set_vertex_t>(c);
+			auto & v = cpu.vvertex[id];
+			if(v.empty() && set_vertex.data)
+				v.assign((const vector4 *)set_vertex.data, (const vector4 *)set_vertex.data + set_vertex.size / sizeof(vector4));
+			cpu.vertex = id;
+			break;
+		}
+		case CMD_SET_INDEX: {
+			auto & set_index = GetPayload<set_index_t>(c);
+			auto & v = cpu.vindex[id];
+			if(v.empty() && set_index.data)
+				v.assign((const uint32_t *)set_index.data, (const uint32_t *)set_index.data + set_index.size / sizeof(uint32_t));
+			cpu.index = id;
+			break;
+		}
+		case CMD_SET_CONSTANT: {
+			auto & set_constant = GetPayload<set_constant_t>(c);
+			if(cpu.is_compute || set_constant.slot < 0 || set_constant.slot >= cpu.slotmax)
+				break;
+			auto p = (const uint8_t *)set_constant.data;
+			cpu.vconstant[set_constant.slot].assign(p, p + (p ? set_constant.size : 0));
+			break;
+		}
+		case CMD_SET_SHADER:
+			cpu.shader = id;
+			cpu.is_compute = false;
+			break;
+		case CMD_CLEAR: {
+			auto & image = cpu.vimage[id];
+			std::fill(image.vtexel.begin(), image.vtexel.end(), PackColor(GetPayload<clear_t>(c).color));
+			break;
+		}
+		case CMD_CLEAR_DEPTH: {
+			auto & image = cpu.vimage[id];
+			std::fill(image.vdepth.begin(), image.vdepth.end(), GetPayload<clear_depth_t>(c).depth);
+			break;
+		}
+		case CMD_DRAW_INDEX: {
+			auto & draw_index = GetPayload<draw_index_t>(c);
+			DrawCpu(cpu, draw_index.count, 1, draw_index.start, 0, 0);
+			break;
+		}
+		case CMD_DRAW_INDEXED_INSTANCED: {
+			auto & draw = GetPayload<draw_indexed_instanced_t>(c);
+			DrawCpu(cpu, draw.index_count, draw.instance_count, draw.start_index, draw.base_vertex, draw.start_instance);
+			break;
+		}
+		case CMD_DRAW_INDIRECT: {
+			auto & draw_indirect = GetPayload<draw_indirect_t>(c);
+			auto & v = cpu.vargs[id];
+			if(v.empty() && draw_indirect.data) {
+				auto p = (const D3D12_DRAW_INDEXED_ARGUMENTS *)draw_indirect.data;
+				v.assign(p, p + draw_indirect.size / sizeof(D3D12_DRAW_INDEXED_ARGUMENTS));
+			}
+			auto first = size_t(draw_indirect.offset / sizeof(D3D12_DRAW_INDEXED_ARGUMENTS));
+			for(size_t i = first ; i < v.size() && i < first + draw_indirect.max_count; i++) {
+				auto & x = v[i];
+				DrawCpu(cpu, int(x.IndexCountPerInstance), int(x.InstanceCount), int(x.StartIndexLocation),
+					x.BaseVertexLocation, int(x.StartInstanceLocation));
+			}
+			break;
+		}
+		case CMD_SET_COMPUTE_SHADER:
+			cpu.is_compute = true;
+			cpu.stats.skipped_count++;
+			break;
+		default:
+			cpu.stats.skipped_count++;
+			break;
+		}
+	}
+	cpu.stats.execute_us += GetMicroSeconds() - start;
+}
+
+//Texels that differ between the images two devices hold for the same names.
+uint64_t CompareCpuImages(const cpudevice & a, const cpudevice & b)
+{
+	uint64_t diff = 0;
+	for(size_t id = 0 ; id < std::max(a.vimage.size(), b.vimage.size()); id++) {
+		static const cpuimage empty;
+		auto & x = id < a.vimage.size() ? a.vimage[id] : empty;
+		auto & y = id < b.vimage.size() ? b.vimage[id] : empty;
+		if(x.w != y.w || x.h != y.h) {
+			diff += std::max(x.vtexel.size(), y.vtexel.size());
+			continue;
+		}
+		for(size_t i = 0 ; i < x.vtexel.size(); i++)
+			diff += x.vtexel[i] != y.vtexel[i];
+	}
+	return diff;
+}
+
+bool WriteCpuImage(const cpuimage & image, const char *path)
+{
+	auto fp = fopen(path, "wb");
+	if(fp == nullptr)
+		return false;
+	fprintf(fp, "P6\n%d %d\n255\n", image.w, image.h);
+	std::vector<uint8_t> vrow(size_t(image.w) * 3);
+	for(int y = 0 ; y < image.h; y++) {
+		for(int x = 0 ; x < image.w; x++) {
+			auto c = image.vtexel[size_t(y) * image.w + x];
+			vrow[x * 3 + 0] = uint8_t(c);
+			vrow[x * 3 + 1] = uint8_t(c >> 8);
+			vrow[x * 3 + 2] = uint8_t(c >> 16);
+		}
+		fwrite(vrow.data(), 1, vrow.size(), fp);
+	}
+	fclose(fp);
+	return true;
+}
+
+//Ports of the sample shaders.
+vector4 QuadVertex(const vector4 & position, float scale, vector4 & varying)
+{
+	auto u = position.x * 0.5f + 0.5f;
+	auto v = position.y * 0.5f + 0.5f;
+	varying = {u, v, u, v};
+	auto ret = position;
+	ret.x *= scale;
+	ret.y *= scale;
+	return ret;
+}
+
+void RegisterReferenceShaders()
+{
+	struct constdata {
+		vector4 color;
+		vector4 misc;
+	};
+	cpushader present;
+	present.vs = [](const vector4 & position, int, const cpucontext &, vector4 & varying) {
+		return QuadVertex(position, 1.0f, varying);
+	};
+	present.ps = [](const vector4 & varying, const cpucontext & ctx) {
+		auto c = ctx.Sample(0, SAMPLER_LINEAR, varying.x, varying.y);
+		return vector4 {c.z, c.y, c.x, c.w};
+	};
+	RegisterCpuShader("present.hlsl", present);
+
+	cpushader test;
+	test.vs = [](const vector4 & position, int, const cpucontext &, vector4 & varying) {
+		return QuadVertex(position, 0.95f, varying);
+	};
+	test.ps = [](const vector4 & varying, const cpucontext & ctx) {
+		auto misc = ctx.Constant<constdata>(0).misc;
+		auto tm = misc.x * 0.5f;
+		auto jx = cosf(tm);
+		auto jy = sinf(tm);
+		auto u = cosf(tm) * varying.x - sinf(tm) * varying.y;
+		auto v = sinf(tm) * varying.x + cosf(tm) * varying.y;
+		auto a = ctx.Sample(0, SAMPLER_LINEAR, 2.0f * cosf(u) + jx, 2.0f * cosf(v) + jy);
+		auto b = ctx.Sample(1, SAMPLER_LINEAR, expf(u) + jx, expf(v) + jy);
+		const float scale[4] = {1.0f, 2.0f, 3.0f, 0.4f};
+		vector4 ret;
+		for(int i = 0 ; i < 4; i++)
+			ret.data[i] = cosf(a.data[i]) - b.data[i] * scale[i] * 0.99f;
+		return ret;
+	};
+	RegisterCpuShader("test.hlsl", test);
+}
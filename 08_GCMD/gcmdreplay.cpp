@@ -0,0 +1,598 @@
+//Replays a capture written by "gcmd.exe -capture file" through the translation layer against the
+//stub device, and reports the CPU cost per command type. No window or GPU is needed.
+//With -cpu the frames run on the CPU reference backend in gcmdcpu.cpp instead.
+#define GCMD_REPLAY
+#include "gcmd.cpp"
+#include "gcmdcpu.cpp"
+#include "stubdevice.h"
+#include <random>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct capturefile {
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	std::vector<uint8_t> vbuffer;
+};
+
+//Maps the file on POSIX. The Windows build uses the stub headers too, so it reads the file instead.
+bool MapCapture(capturefile & file, const char *path)
+{
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st = {};
+	fstat(fd, &st);
+	auto addr = st.st_size ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if(addr == MAP_FAILED)
+		return false;
+	file.data = (const uint8_t *)addr;
+	file.size = st.st_size;
+#else
+	auto fp = fopen(path, "rb");
+	if(fp == nullptr)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	file.vbuffer.resize(ftell(fp));
+	fseek(fp, 0, SEEK_SET);
+	fread(file.vbuffer.data(), 1, file.vbuffer.size(), fp);
+	fclose(fp);
+	file.data = file.vbuffer.data();
+	file.size = file.vbuffer.size();
+#endif
+	return true;
+}
+
+void UnmapCapture(capturefile & file)
+{
+#ifndef _WIN32
+	if(file.data)
+		munmap((void *)file.data, file.size);
+#endif
+	file.data = nullptr;
+	file.size = 0;
+}
+
+//Copies one frame into vcmd. Ids are remapped to this process and data pointers point into the file.
+//Returns nullptr when the frame is truncated.
+const uint8_t * ReadCaptureFrame(const uint8_t *p, const uint8_t *end, std::vector<uint32_t> & vremap, cmdbuffer & vcmd)
+{
+	captureframe frame = {};
+	if(size_t(end - p) < sizeof(frame))
+		return nullptr;
+	memcpy(&frame, p, sizeof(frame));
+	p += sizeof(frame);
+	if(frame.name_begin != vremap.size())
+		return nullptr;
+
+	auto names = p;
+	for(uint32_t i = 0 ; i < frame.name_count; i++) {
+		uint32_t len = 0;
+		if(size_t(end - p) < sizeof(len))
+			return nullptr;
+		memcpy(&len, p, sizeof(len));
+		p += sizeof(len);
+		if(size_t(end - p) < len)
+			return nullptr;
+		vremap.push_back(GetNameId(std::string((const char *)p, len)));
+		p += len;
+	}
+	p = names + ((p - names + 7) & ~size_t(7));
+	if(p > end || size_t(end - p) < frame.cmd_bytes)
+		return nullptr;
+
+	vcmd.clear();
+	for(uint32_t i = 0 ; i < frame.cmd_count; i++) {
+		cmdheader header = {};
+		if(size_t(end - p) < sizeof(header))
+			return nullptr;
+		memcpy(&header, p, sizeof(header));
+		if(header.size < sizeof(header) || size_t(end - p) < header.size || header.type >= CMD_MAX || header.id >= vremap.size())
+			return nullptr;
+		auto c = vcmd.append((const cmdheader *)p);
+		c->id = vremap[c->id];
+		p += header.size;
+		size_t size = 0;
+		auto data = GetCmdData(c, size);
+		if(data && size) {
+			if(size_t(end - p) < size)
+				return nullptr;
+			*data = (void *)p;
+			p += (size + 7) & ~size_t(7);
+		} else if(data) {
+			*data = nullptr;
+		}
+	}
+	return p;
+}
+
+//Captures frames built on this thread while a render thread translates them with the depth prepass,
+//which interns the pipeline variant names behind the capture's back, and reads the file back. A
+//second thread interns names too, so a frame is likely to be captured while the count moves.
+//Leaves the device running for CheckBarriers and returns the number of failed checks.
+int CheckCapture()
+{
+	enum { Width = 1280, Height = 720, BufferMax = 2, ResourceMax = 1024, ShaderSlotMax = 8, FrameMax = 256 };
+	const char *path = "gcmdreplay_selftest.bin";
+	vector4 vtx[] = {{-1, 1, 0, 1}, {-1, -1, 0, 1}, {1, 1, 0, 1}, {1, -1, 0, 1}};
+	uint32_t idx[] = {0, 1, 2, 2, 1, 3};
+	std::vector<uint32_t> vtex(64 * 64, 0xFF808080);
+	vector4 constant[2] = {};
+	auto hwnd = reinterpret_cast<HWND>(uintptr_t(1));
+	int failed = 0;
+	auto check = [&](bool ok, const char *what) {
+		printf("CheckCapture : %s %s\n", ok ? "ok  " : "FAIL", what);
+		failed += ok ? 0 : 1;
+	};
+
+	capturewriter cap;
+	if(!CaptureBegin(cap, path, Width, Height, BufferMax, ResourceMax, ShaderSlotMax)) {
+		check(false, "the capture file opens");
+		return failed;
+	}
+	GetPresentOption().depth_prepass = true;
+	framequeue queue;
+	queue.start(2, [&](cmdbuffer & vcmd) {
+		PresentGraphics(vcmd, hwnd, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+	});
+	std::atomic<bool> quit {false};
+	std::thread intern([&] {
+		for(int i = 0 ; !quit && i < (1 << 18); i++)
+			GetNameId("capturename" + std::to_string(i));
+	});
+	cmdbuffer vcmd;
+	SetTexture(vcmd, "capturetex", 0, 64, 64, vtex.data(), vtex.size() * sizeof(uint32_t));
+	for(int frame = 0 ; frame < FrameMax; frame++) {
+		auto index = std::to_string(frame % BufferMax);
+		auto offscreen = "captureoffscreen" + index;
+		SetRenderTarget(vcmd, offscreen, Width, Height, true);
+		ClearRenderTarget(vcmd, offscreen, {0, 0, 0, 1});
+		ClearDepth(vcmd, offscreen);
+		//A new shader every frame, so the render thread keeps interning variant names.
+		SetShader(vcmd, "capture" + std::to_string(frame) + ".hlsl", false);
+		SetTexture(vcmd, "capturetex", 0);
+		SetVertex(vcmd, "testvertex", vtx, sizeof(vtx), sizeof(vector4));
+		SetIndex(vcmd, "testindex", idx, sizeof(idx));
+		SetConstant(vcmd, "captureconstant" + std::to_string(frame), 0, constant, sizeof(constant));
+		DrawIndex(vcmd, "capturedraw", 0, 6, 0.5f);
+		auto backbuffer = "backbuffer" + index;
+		SetRenderTarget(vcmd, backbuffer, Width, Height);
+		ClearRenderTarget(vcmd, backbuffer, {0, 0, 0, 1});
+		SetShader(vcmd, "present.hlsl", false);
+		SetTexture(vcmd, offscreen, 0);
+		DrawIndex(vcmd, "presentdraw", 0, 6);
+		CaptureFrame(cap, vcmd);
+		queue.publish(vcmd);
+	}
+	queue.stop();
+	quit = true;
+	intern.join();
+	CaptureEnd(cap);
+	GetPresentOption().depth_prepass = false;
+
+	capturefile file;
+	if(!MapCapture(file, path)) {
+		check(false, "the capture file maps");
+		return failed;
+	}
+	std::vector<uint32_t> vremap;
+	int frame_count = 0;
+	auto end = file.data + file.size;
+	for(auto p = file.data + sizeof(captureheader); p && p < end; frame_count += p ? 1 : 0)
+		p = ReadCaptureFrame(p, end, vremap, vcmd);
+	bool is_same = true;
+	for(uint32_t i = 0 ; i < vremap.size(); i++)
+		is_same = is_same && vremap[i] == i;
+	UnmapCapture(file);
+	remove(path);
+	check(frame_count == FrameMax, "every frame reads back");
+	check(is_same, "names read back in the order they were interned");
+	return failed;
+}
+
+//Runs the sample frame of gcmd.exe against the stub device: an offscreen target with depth sampled
+//by three post passes in transient targets, and the backbuffer. Checks the barrier batches the stub
+//command lists recorded for the last frame and returns the number of failed checks.
+int CheckBarriers()
+{
+	enum { Width = 1280, Height = 720, BufferMax = 2, ResourceMax = 1024, ShaderSlotMax = 8, FrameMax = 3 };
+	vector4 vtx[] = {{-1, 1, 0, 1}, {-1, -1, 0, 1}, {1, 1, 0, 1}, {1, -1, 0, 1}};
+	uint32_t idx[] = {0, 1, 2, 2, 1, 3};
+	std::vector<uint32_t> vtex(256 * 256, 0xFF808080);
+	vector4 constant[2] = {};
+	auto hwnd = reinterpret_cast<HWND>(uintptr_t(1));
+	cmdbuffer vcmd;
+	SetTexture(vcmd, "testtex", 0, 256, 256, vtex.data(), vtex.size() * sizeof(uint32_t));
+	StubRecordBarriers(true);
+	for(int frame = 0 ; frame < FrameMax; frame++) {
+		auto index = std::to_string(frame % BufferMax);
+		auto offscreen = "offscreen" + index;
+		SetRenderTarget(vcmd, offscreen, Width, Height, true);
+		ClearRenderTarget(vcmd, offscreen, {1, 0, 0, 1});
+		ClearDepth(vcmd, offscreen);
+		SetShader(vcmd, "test.hlsl", false);
+		SetTexture(vcmd, "testtex", 0);
+		SetVertex(vcmd, "testvertex", vtx, sizeof(vtx), sizeof(vector4));
+		SetIndex(vcmd, "testindex", idx, sizeof(idx));
+		SetConstant(vcmd, "testconstant" + index, 0, constant, sizeof(constant));
+		DrawIndex(vcmd, "offscreendraw", 0, 6);
+		std::string source = offscreen;
+		for(auto post : {"post0", "post1", "post2"}) {
+			SetTransientRenderTarget(vcmd, post, Width, Height);
+			ClearRenderTarget(vcmd, post, {0, 0, 0, 1});
+			SetShader(vcmd, "present.hlsl", false);
+			SetTexture(vcmd, source, 0);
+			DrawIndex(vcmd, "postdraw", 0, 6);
+			source = post;
+		}
+		auto backbuffer = "backbuffer" + index;
+		SetRenderTarget(vcmd, backbuffer, Width, Height);
+		ClearRenderTarget(vcmd, backbuffer, {1, 0, 0, 1});
+		SetTexture(vcmd, source, 0);
+		DrawIndex(vcmd, "presentdraw", 0, 6);
+		StubBarrierLog().clear();
+		PresentGraphics(vcmd, hwnd, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+	}
+	auto vlog = StubBarrierLog();
+	StubRecordBarriers(false);
+	PresentGraphics(vcmd, nullptr, Width, Height, BufferMax, ResourceMax, ShaderSlotMax);
+
+	int failed = 0;
+	auto check = [&](bool ok, const char *what) {
+		printf("CheckBarriers : %s %s\n", ok ? "ok  " : "FAIL", what);
+		failed += ok ? 0 : 1;
+	};
+	auto is_same = [](const D3D12_RESOURCE_BARRIER & a, const D3D12_RESOURCE_BARRIER & b) {
+		return a.Transition.pResource == b.Transition.pResource && a.Transition.StateBefore == b.Transition.StateBefore &&
+			a.Transition.StateAfter == b.Transition.StateAfter;
+	};
+	bool has_resource = true;
+	bool is_paired = true;
+	int split_count = 0;
+	std::vector<ID3D12Resource *> valiased;
+	for(size_t i = 0 ; i < vlog.size(); i++) {
+		for(auto & x : vlog[i]) {
+			if(x.Type == D3D12_RESOURCE_BARRIER_TYPE_ALIASING) {
+				has_resource = has_resource && x.Aliasing.pResourceAfter;
+				valiased.push_back(x.Aliasing.pResourceAfter);
+				continue;
+			}
+			has_resource = has_resource && x.Transition.pResource;
+			if(x.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+				continue;
+			//A split begins in one batch and ends in a later one, with the same states.
+			if(x.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) {
+				bool ended = false;
+				for(size_t j = i + 1 ; j < vlog.size() && !ended; j++)
+					for(auto & y : vlog[j])
+						ended = ended || (y.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY && is_same(x, y));
+				is_paired = is_paired && ended;
+				split_count++;
+			}
+			if(x.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) {
+				bool begun = false;
+				for(size_t j = 0 ; j < i && !begun; j++)
+					for(auto & y : vlog[j])
+						begun = begun || (y.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY && is_same(x, y));
+				is_paired = is_paired && begun;
+			}
+		}
+	}
+	check(!vlog.empty(), "the frame recorded barriers");
+	check(has_resource, "every barrier has its resource");
+	check(split_count >= 4 && is_paired, "offscreen, post0, post1 and post2 end in split transitions, each BEGIN_ONLY has a later END_ONLY");
+
+	//Each transient is aliased in front of its first use and then sampled by the next pass.
+	bool is_sampled = valiased.size() == 3;
+	for(auto res : valiased) {
+		bool sampled = false;
+		for(auto & batch : vlog)
+			for(auto & x : batch)
+				sampled = sampled || (x.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && x.Transition.pResource == res &&
+					x.Transition.StateBefore == D3D12_RESOURCE_STATE_RENDER_TARGET && (x.Transition.StateAfter & StateShaderResource));
+		is_sampled = is_sampled && sampled;
+	}
+	check(is_sampled, "one aliasing barrier per transient, each one later goes from render target to shader resource");
+
+	bool is_present = false;
+	if(!vlog.empty())
+		for(auto & x : vlog.back())
+			is_present = is_present || (x.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && x.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE &&
+				x.Transition.StateBefore == D3D12_RESOURCE_STATE_RENDER_TARGET && x.Transition.StateAfter == D3D12_RESOURCE_STATE_PRESENT);
+	check(is_present, "the last batch returns the backbuffer to present");
+	return failed;
+}
+
+//Allocates mixed sizes and alignments from a 1MB buddyallocator with 4KB blocks, frees them in a
+//shuffled order, and returns the number of failed checks.
+int CheckBuddyAllocator()
+{
+	const uint64_t KB = 1024;
+	int failed = 0;
+	auto check = [&](bool ok, const char *what) {
+		printf("CheckBuddyAllocator : %s %s\n", ok ? "ok  " : "FAIL", what);
+		failed += ok ? 0 : 1;
+	};
+	buddyallocator buddy;
+	buddy.init(1024 * KB, 4 * KB);
+	check(buddy.size == 1024 * KB && buddy.GetLargestFree() == 1024 * KB && buddy.GetFragmentation() == 0.0, "starts as one free 1MB block");
+
+	//One 4KB block splits every order above it, leaving 512KB as the largest of 1020KB free.
+	auto first = buddy.alloc(4 * KB, 4 * KB);
+	check(first == 0 && buddy.used == 4 * KB && buddy.GetLargestFree() == 512 * KB, "a 4KB block leaves 512KB as the largest free block");
+	check(std::abs(buddy.GetFragmentation() - (1.0 - 512.0 / 1020.0)) < 1e-9, "fragmentation is 1 - 512KB / 1020KB");
+	check(buddy.alloc(2048 * KB, 4 * KB) == buddyallocator::InvalidOffset, "a request larger than the heap fails");
+
+	struct block {
+		uint64_t offset, size, align;
+	};
+	std::vector<block> vblock = {{first, 4 * KB, 4 * KB}};
+	std::mt19937 random(12345);
+	const uint64_t vsize[] = {1 * KB, 4 * KB, 6 * KB, 10 * KB, 32 * KB, 100 * KB};
+	const uint64_t valign[] = {256, 4 * KB, 64 * KB};
+	bool is_aligned = true;
+	for(;;) {
+		auto size = vsize[random() % _countof(vsize)];
+		auto align = valign[random() % _countof(valign)];
+		auto offset = buddy.alloc(size, align);
+		if(offset == buddyallocator::InvalidOffset)
+			break;
+		is_aligned = is_aligned && offset % align == 0 && offset + size <= buddy.size;
+		vblock.push_back({offset, size, align});
+	}
+	check(vblock.size() > 8, "mixed requests fill the heap until one fails");
+	check(is_aligned, "offsets are aligned and inside the heap");
+
+	//The block a request takes is its size and alignment rounded up to a power of two.
+	auto vsorted = vblock;
+	std::sort(vsorted.begin(), vsorted.end(), [](const block & a, const block & b) { return a.offset < b.offset; });
+	bool is_disjoint = true;
+	uint64_t used = 0;
+	for(size_t i = 0 ; i < vsorted.size(); i++) {
+		auto taken = buddy.minblock << buddy.GetOrder(std::max(vsorted[i].size, vsorted[i].align));
+		used += taken;
+		if(i + 1 < vsorted.size())
+			is_disjoint = is_disjoint && vsorted[i].offset + taken <= vsorted[i + 1].offset;
+	}
+	check(is_disjoint, "allocated blocks do not overlap");
+	check(used == buddy.used, "used bytes match the blocks handed out");
+
+	std::shuffle(vblock.begin(), vblock.end(), random);
+	for(auto & x : vblock)
+		buddy.free(x.offset, x.size, x.align);
+	bool is_single = buddy.vfree.back().size() == 1;
+	for(size_t k = 0 ; k + 1 < buddy.vfree.size(); k++)
+		is_single = is_single && buddy.vfree[k].empty();
+	check(buddy.used == 0 && is_single, "freeing in shuffled order coalesces back into one block");
+	check(buddy.GetLargestFree() == 1024 * KB && buddy.GetFragmentation() == 0.0, "largest free is 1MB and fragmentation is 0 again");
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc == 2 && std::string(argv[1]) == "-selftest")
+		return CheckBuddyAllocator() + CheckCapture() + CheckBarriers() ? 2 : 0;
+	if(argc < 2) {
+		printf("usage : gcmdreplay -selftest\n"
+			"        gcmdreplay capture.bin [-loop N] [-threads N] [-sort] [-prepass] [-queue N] [-build-us N] [-reuse] [-bindless] [-copy-queue] [-max-frames N]\n"
+			"                      [-threads-sweep] [-cpu] [-cpu-check] [-dump file.ppm]\n");
+		return 1;
+	}
+	int loop = 100;
+	double build_us = 0.0;
+	bool is_cpu = false;
+	bool is_check = false;
+	bool is_sweep = false;
+	const char *dump = nullptr;
+	for(int i = 2 ; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg == "-loop" && i + 1 < argc)
+			loop = atoi(argv[++i]);
+		if(arg == "-threads" && i + 1 < argc)
+			GetPresentOption().thread_count = UINT(atoi(argv[++i]));
+		if(arg == "-sort")
+			GetPresentOption().sort_draws = true;
+		if(arg == "-prepass")
+			GetPresentOption().depth_prepass = true;
+		if(arg == "-queue" && i + 1 < argc)
+			GetPresentOption().queue_depth = UINT(atoi(argv[++i]));
+		if(arg == "-reuse")
+			GetPresentOption().reuse_segments = true;
+		if(arg == "-bindless")
+			GetPresentOption().bindless = true;
+		if(arg == "-copy-queue")
+			GetPresentOption().copy_queue = true;
+		if(arg == "-max-frames" && i + 1 < argc)
+			GetPresentOption().max_frames = UINT(atoi(argv[++i]));
+		//Executes the frames on the CPU, and with -cpu-check also after the sort and state elimination
+		//passes, and counts the texels that differ.
+		//Replays the capture at 1, 2, 4 and 8 recording threads and compares each with 1 thread.
+		if(arg == "-threads-sweep")
+			is_sweep = true;
+		if(arg == "-cpu")
+			is_cpu = true;
+		if(arg == "-cpu-check")
+			is_cpu = is_check = true;
+		if(arg == "-dump" && i + 1 < argc)
+			dump = argv[++i];
+		//Stands in for the application's own work building each frame.
+		if(arg == "-build-us" && i + 1 < argc)
+			build_us = atof(argv[++i]);
+	}
+
+	capturefile file;
+	if(!MapCapture(file, argv[1])) {
+		printf("ERR : cant map %s\n", argv[1]);
+		return 1;
+	}
+	captureheader header = {};
+	if(file.size < sizeof(header)) {
+		printf("ERR : %s is not a capture\n", argv[1]);
+		return 1;
+	}
+	memcpy(&header, file.data, sizeof(header));
+	if(header.magic != CaptureMagic || header.version != CaptureVersion) {
+		printf("ERR : %s magic=%08X version=%u, expected version %u\n", argv[1], header.magic, header.version, CaptureVersion);
+		return 1;
+	}
+
+	//Any non-null window lets PresentGraphics create the stub swapchain.
+	auto hwnd = reinterpret_cast<HWND>(uintptr_t(1));
+	auto end = file.data + file.size;
+	GetPresentOption().profile = true;
+	cmdbuffer vcmd;
+	framestats total;
+	uint64_t frame_count = 0;
+	auto present = [&](cmdbuffer & vcmd) {
+		framestats stats;
+		PresentGraphics(vcmd, hwnd, header.width, header.height, header.buffer_count, header.heap_count, header.slot_max, &stats);
+		total.cmd_count += stats.cmd_count;
+		total.packet_count += stats.packet_count;
+		total.prepass_count += stats.prepass_count;
+		total.segment_count += stats.segment_count;
+		total.reused_count += stats.reused_count;
+		total.update_bytes += stats.update_bytes;
+		total.transient_bytes += stats.transient_bytes;
+		total.transient_peak += stats.transient_peak;
+		total.placeholder_count += stats.placeholder_count;
+		total.copy_wait_count += stats.copy_wait_count;
+		total.inflight_count += stats.inflight_count;
+		total.wait_us += stats.wait_us;
+		total.gpu_us += stats.gpu_us;
+		total.translate_us += stats.translate_us;
+		for(int type = 0 ; type < CMD_MAX; type++) {
+			total.vtype_count[type] += stats.vtype_count[type];
+			total.vtype_ns[type] += stats.vtype_ns[type];
+		}
+	};
+	cpudevice cpu;
+	cpudevice cpu_check;
+	GraphicsDevice passes;
+	cmdbuffer vcheck;
+	uint64_t check_diff = 0;
+	if(is_cpu) {
+		RegisterReferenceShaders();
+		cpu.init(int(header.slot_max), GetPresentOption().thread_count);
+		cpu_check.init(int(header.slot_max), GetPresentOption().thread_count);
+		passes.slotmax = header.slot_max;
+		GetPresentOption().queue_depth = 0;
+	}
+	if(is_sweep && !is_cpu) {
+		auto replay = [&](int count) {
+			for(int i = 0 ; i < count; i++) {
+				std::vector<uint32_t> vremap;
+				for(auto p = file.data + sizeof(header); p && p < end; frame_count++) {
+					p = ReadCaptureFrame(p, end, vremap, vcmd);
+					if(p)
+						present(vcmd);
+				}
+			}
+		};
+		//The first pass creates the resources and compiles the shaders, and is not timed.
+		replay(1);
+		double base_ns = 0.0;
+		for(UINT thread_count : {1u, 2u, 4u, 8u}) {
+			GetPresentOption().thread_count = thread_count;
+			total = framestats();
+			frame_count = 0;
+			replay(loop);
+			auto ns = frame_count ? total.translate_us * 1000.0 / frame_count : 0.0;
+			if(thread_count == 1)
+				base_ns = ns;
+			printf("threads=%u segment=%llu translate=%.0f ns/frame speedup=%.2f\n", thread_count,
+				(unsigned long long)(frame_count ? total.segment_count / frame_count : 0), ns, ns > 0.0 ? base_ns / ns : 0.0);
+		}
+		PresentGraphics(vcmd, nullptr, header.width, header.height, header.buffer_count, header.heap_count, header.slot_max);
+		UnmapCapture(file);
+		return 0;
+	}
+	framequeue queue;
+	if(GetPresentOption().queue_depth)
+		queue.start(GetPresentOption().queue_depth, present);
+	auto wall_start = GetMicroSeconds();
+	for(int i = 0 ; i < loop; i++) {
+		std::vector<uint32_t> vremap;
+		auto p = file.data + sizeof(header);
+		while(p < end) {
+			auto frame_begin = p;
+			auto vremap_check = vremap;
+			p = ReadCaptureFrame(p, end, vremap, vcmd);
+			if(p == nullptr) {
+				printf("ERR : truncated frame %llu\n", (unsigned long long)frame_count);
+				return 1;
+			}
+			if(is_cpu) {
+				if(is_check) {
+					ReadCaptureFrame(frame_begin, end, vremap_check, vcheck);
+					if(GetPresentOption().sort_draws)
+						SortDraws(passes, vcheck);
+					EliminateRedundantState(passes, vcheck);
+					ExecuteCpuFrame(cpu_check, vcheck);
+				}
+				ExecuteCpuFrame(cpu, vcmd);
+				if(is_check)
+					check_diff += CompareCpuImages(cpu, cpu_check);
+				frame_count++;
+				continue;
+			}
+			for(auto start = GetMicroSeconds(); GetMicroSeconds() - start < build_us; )
+				;
+			if(GetPresentOption().queue_depth)
+				queue.publish(vcmd);
+			else
+				present(vcmd);
+			frame_count++;
+		}
+	}
+	queue.stop();
+	auto wall_us = GetMicroSeconds() - wall_start;
+	if(is_cpu) {
+		UnmapCapture(file);
+		auto & stats = cpu.stats;
+		printf("cpu frames=%llu threads=%u draw=%llu triangle=%llu pixel=%llu skipped=%llu hazard=%llu execute=%f us/frame\n",
+			(unsigned long long)frame_count, cpu.thread_count, (unsigned long long)stats.draw_count, (unsigned long long)stats.triangle_count, (unsigned long long)stats.pixel_count,
+			(unsigned long long)stats.skipped_count, (unsigned long long)stats.hazard_count, frame_count ? stats.execute_us / frame_count : 0.0);
+		if(is_check)
+			printf("cpu check : %llu texels differ after the passes\n", (unsigned long long)check_diff);
+		if(dump && cpu.rendertarget != ~0u) {
+			if(WriteCpuImage(cpu.vimage[cpu.rendertarget], dump))
+				printf("cpu : wrote %s to %s\n", GetName(cpu.rendertarget), dump);
+			else
+				printf("ERR : cant write %s\n", dump);
+		}
+		cpu.pool.stop();
+		cpu_check.pool.stop();
+		return check_diff ? 2 : 0;
+	}
+	PresentGraphics(vcmd, nullptr, header.width, header.height, header.buffer_count, header.heap_count, header.slot_max);
+	UnmapCapture(file);
+
+	printf("frames=%llu threads=%u cmd=%llu packet=%llu prepass=%llu update=%llu bytes/frame translate=%f us/frame\n", (unsigned long long)frame_count,
+		GetPresentOption().thread_count, (unsigned long long)total.cmd_count, (unsigned long long)total.packet_count, (unsigned long long)total.prepass_count,
+		(unsigned long long)(frame_count ? total.update_bytes / frame_count : 0), frame_count ? total.translate_us / frame_count : 0.0);
+	printf("segment=%llu reused=%llu\n", (unsigned long long)total.segment_count, (unsigned long long)total.reused_count);
+	printf("placeholder=%llu bindings, copy queue waited in %llu frames\n", (unsigned long long)total.placeholder_count, (unsigned long long)total.copy_wait_count);
+	printf("transient=%llu bytes/frame, aliased into %llu bytes/frame\n", (unsigned long long)(frame_count ? total.transient_bytes / frame_count : 0),
+		(unsigned long long)(frame_count ? total.transient_peak / frame_count : 0));
+	printf("max-frames=%u inflight=%f frames wait=%f us/frame gpu=%f us/frame\n", GetPresentOption().max_frames,
+		frame_count ? double(total.inflight_count) / frame_count : 0.0, frame_count ? total.wait_us / frame_count : 0.0,
+		frame_count ? total.gpu_us / frame_count : 0.0);
+	printf("queue=%u frame=%f us/frame, waited %llu frames %f us\n", GetPresentOption().queue_depth,
+		frame_count ? wall_us / frame_count : 0.0, (unsigned long long)queue.wait_count, queue.wait_us);
+	for(int type = 0 ; type < CMD_MAX; type++) {
+		auto count = total.vtype_count[type];
+		if(count == 0)
+			continue;
+		printf("%-28s count=%-10llu total=%12.0f ns %10.1f ns/cmd\n", GetCmdName(type), (unsigned long long)count,
+			total.vtype_ns[type], total.vtype_ns[type] / count);
+	}
+	StubReport();
+	return 0;
+}
@@ -1,4 +1,14 @@
+#ifdef GCMD_BINDLESS
+//gcmd.exe -bindless : every SRV of the heap, and the descriptor index of each texture slot.
+Texture2D<float4> vtexture[] : register(t0, space1);
+cbuffer bindless : register(b0, space1)
+{
+	uint4 vslot[2];
+};
+#define tex0 vtexture[vslot[0].x]
+#else
 Texture2D<float4> tex0 : register(t0);
+#endif
 SamplerState PointSampler   : register(s0);
 SamplerState LinearSampler  : register(s1);
 
@@ -0,0 +1,182 @@
+#pragma once
+//Stub of the D3D12 declarations gcmd.cpp uses, implemented by stubdevice.cpp.
+#include "windows.h"
+enum DXGI_FORMAT { DXGI_FORMAT_UNKNOWN = 0, DXGI_FORMAT_R32G32B32A32_FLOAT = 2, DXGI_FORMAT_R8G8B8A8_UNORM = 28, DXGI_FORMAT_R32_UINT = 42, DXGI_FORMAT_R32_FLOAT = 41, DXGI_FORMAT_D32_FLOAT = 40, DXGI_FORMAT_R32_TYPELESS = 39, DXGI_FORMAT_R16_UINT = 57 };
+struct DXGI_SAMPLE_DESC { UINT Count, Quality; };
+enum D3D_FEATURE_LEVEL { D3D_FEATURE_LEVEL_11_0 = 0xb000, D3D_FEATURE_LEVEL_11_1 = 0xb100, D3D_FEATURE_LEVEL_12_0 = 0xc000 };
+enum D3D_PRIMITIVE_TOPOLOGY { D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4, D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5 };
+enum D3D_ROOT_SIGNATURE_VERSION { D3D_ROOT_SIGNATURE_VERSION_1_0 = 1, D3D_ROOT_SIGNATURE_VERSION_1_1 = 2 };
+struct ID3DBlob : IUnknown { virtual void *GetBufferPointer() = 0; virtual SIZE_T GetBufferSize() = 0; };
+typedef ID3DBlob ID3D10Blob;
+#define D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES 0xffffffff
+#define D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING 0x1688
+#define D3D12_FLOAT32_MAX 3.402823466e+38f
+#define D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND 0xffffffff
+#define D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT 256
+#define D3D12_TEXTURE_DATA_PITCH_ALIGNMENT 256
+#define D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT 512
+#define D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT 65536
+#define D3D12_DEFAULT_DEPTH_BIAS 0
+#define D3D12_DEFAULT_STENCIL_READ_MASK 0xff
+#define D3D12_DEFAULT_STENCIL_WRITE_MASK 0xff
+enum D3D12_COMMAND_LIST_TYPE { D3D12_COMMAND_LIST_TYPE_DIRECT = 0, D3D12_COMMAND_LIST_TYPE_BUNDLE = 1, D3D12_COMMAND_LIST_TYPE_COMPUTE = 2, D3D12_COMMAND_LIST_TYPE_COPY = 3 };
+enum D3D12_COMMAND_QUEUE_FLAGS { D3D12_COMMAND_QUEUE_FLAG_NONE = 0 };
+struct D3D12_COMMAND_QUEUE_DESC { D3D12_COMMAND_LIST_TYPE Type; INT Priority; D3D12_COMMAND_QUEUE_FLAGS Flags; UINT NodeMask; };
+enum D3D12_DESCRIPTOR_HEAP_TYPE { D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, D3D12_DESCRIPTOR_HEAP_TYPE_DSV };
+enum D3D12_DESCRIPTOR_HEAP_FLAGS { D3D12_DESCRIPTOR_HEAP_FLAG_NONE = 0, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE = 1 };
+struct D3D12_DESCRIPTOR_HEAP_DESC { D3D12_DESCRIPTOR_HEAP_TYPE Type; UINT NumDescriptors; D3D12_DESCRIPTOR_HEAP_FLAGS Flags; UINT NodeMask; };
+struct D3D12_CPU_DESCRIPTOR_HANDLE { SIZE_T ptr; };
+struct D3D12_GPU_DESCRIPTOR_HANDLE { UINT64 ptr; };
+typedef UINT64 D3D12_GPU_VIRTUAL_ADDRESS;
+enum D3D12_RESOURCE_DIMENSION { D3D12_RESOURCE_DIMENSION_UNKNOWN, D3D12_RESOURCE_DIMENSION_BUFFER, D3D12_RESOURCE_DIMENSION_TEXTURE1D, D3D12_RESOURCE_DIMENSION_TEXTURE2D };
+enum D3D12_TEXTURE_LAYOUT { D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_TEXTURE_LAYOUT_ROW_MAJOR };
+enum D3D12_RESOURCE_FLAGS { D3D12_RESOURCE_FLAG_NONE = 0, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET = 1, D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL = 2, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS = 4, D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE = 8 };
+inline D3D12_RESOURCE_FLAGS operator|(D3D12_RESOURCE_FLAGS a, D3D12_RESOURCE_FLAGS b) { return D3D12_RESOURCE_FLAGS(int(a) | int(b)); }
+struct D3D12_RESOURCE_DESC { D3D12_RESOURCE_DIMENSION Dimension; UINT64 Alignment; UINT64 Width; UINT Height; UINT16 DepthOrArraySize; UINT16 MipLevels; DXGI_FORMAT Format; DXGI_SAMPLE_DESC SampleDesc; D3D12_TEXTURE_LAYOUT Layout; D3D12_RESOURCE_FLAGS Flags; };
+enum D3D12_HEAP_TYPE { D3D12_HEAP_TYPE_DEFAULT = 1, D3D12_HEAP_TYPE_UPLOAD = 2, D3D12_HEAP_TYPE_READBACK = 3 };
+enum D3D12_CPU_PAGE_PROPERTY { D3D12_CPU_PAGE_PROPERTY_UNKNOWN };
+enum D3D12_MEMORY_POOL { D3D12_MEMORY_POOL_UNKNOWN };
+struct D3D12_HEAP_PROPERTIES { D3D12_HEAP_TYPE Type; D3D12_CPU_PAGE_PROPERTY CPUPageProperty; D3D12_MEMORY_POOL MemoryPoolPreference; UINT CreationNodeMask; UINT VisibleNodeMask; };
+enum D3D12_HEAP_FLAGS { D3D12_HEAP_FLAG_NONE = 0, D3D12_HEAP_FLAG_DENY_BUFFERS = 0x4, D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES = 0x40, D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES = 0x80,
+	D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS = 0xc0, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES = 0x44, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES = 0x84 };
+struct D3D12_HEAP_DESC { UINT64 SizeInBytes; D3D12_HEAP_PROPERTIES Properties; UINT64 Alignment; D3D12_HEAP_FLAGS Flags; };
+struct D3D12_RESOURCE_ALLOCATION_INFO { UINT64 SizeInBytes; UINT64 Alignment; };
+enum D3D12_RESOURCE_STATES : int { D3D12_RESOURCE_STATE_COMMON = 0, D3D12_RESOURCE_STATE_PRESENT = 0, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 1, D3D12_RESOURCE_STATE_INDEX_BUFFER = 2,
+	D3D12_RESOURCE_STATE_RENDER_TARGET = 4, D3D12_RESOURCE_STATE_UNORDERED_ACCESS = 8, D3D12_RESOURCE_STATE_DEPTH_WRITE = 0x10, D3D12_RESOURCE_STATE_DEPTH_READ = 0x20,
+	D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT = 0x200,
+	D3D12_RESOURCE_STATE_COPY_DEST = 0x400, D3D12_RESOURCE_STATE_COPY_SOURCE = 0x800, D3D12_RESOURCE_STATE_GENERIC_READ = 0xac3, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE = 0xc0 };
+inline D3D12_RESOURCE_STATES operator|(D3D12_RESOURCE_STATES a, D3D12_RESOURCE_STATES b) { return D3D12_RESOURCE_STATES(int(a) | int(b)); }
+enum D3D12_RESOURCE_BARRIER_TYPE { D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, D3D12_RESOURCE_BARRIER_TYPE_ALIASING, D3D12_RESOURCE_BARRIER_TYPE_UAV };
+enum D3D12_RESOURCE_BARRIER_FLAGS { D3D12_RESOURCE_BARRIER_FLAG_NONE = 0, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY = 1, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY = 2 };
+struct ID3D12Resource;
+struct D3D12_RESOURCE_TRANSITION_BARRIER { ID3D12Resource *pResource; UINT Subresource; D3D12_RESOURCE_STATES StateBefore; D3D12_RESOURCE_STATES StateAfter; };
+struct D3D12_RESOURCE_ALIASING_BARRIER { ID3D12Resource *pResourceBefore; ID3D12Resource *pResourceAfter; };
+struct D3D12_RESOURCE_UAV_BARRIER { ID3D12Resource *pResource; };
+struct D3D12_RESOURCE_BARRIER { D3D12_RESOURCE_BARRIER_TYPE Type; D3D12_RESOURCE_BARRIER_FLAGS Flags; union { D3D12_RESOURCE_TRANSITION_BARRIER Transition; D3D12_RESOURCE_ALIASING_BARRIER Aliasing; D3D12_RESOURCE_UAV_BARRIER UAV; }; };
+struct D3D12_SUBRESOURCE_FOOTPRINT { DXGI_FORMAT Format; UINT Width, Height, Depth, RowPitch; };
+struct D3D12_PLACED_SUBRESOURCE_FOOTPRINT { UINT64 Offset; D3D12_SUBRESOURCE_FOOTPRINT Footprint; };
+enum D3D12_TEXTURE_COPY_TYPE { D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX, D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT };
+struct D3D12_TEXTURE_COPY_LOCATION { ID3D12Resource *pResource; D3D12_TEXTURE_COPY_TYPE Type; union { D3D12_PLACED_SUBRESOURCE_FOOTPRINT PlacedFootprint; UINT SubresourceIndex; }; };
+struct D3D12_BOX { UINT left, top, front, right, bottom, back; };
+struct D3D12_RANGE { SIZE_T Begin, End; };
+enum D3D12_SRV_DIMENSION { D3D12_SRV_DIMENSION_BUFFER = 1, D3D12_SRV_DIMENSION_TEXTURE2D = 4 };
+struct D3D12_TEX2D_SRV { UINT MostDetailedMip, MipLevels, PlaneSlice; FLOAT ResourceMinLODClamp; };
+struct D3D12_BUFFER_SRV { UINT64 FirstElement; UINT NumElements; UINT StructureByteStride; UINT Flags; };
+struct D3D12_SHADER_RESOURCE_VIEW_DESC { DXGI_FORMAT Format; D3D12_SRV_DIMENSION ViewDimension; UINT Shader4ComponentMapping; union { D3D12_BUFFER_SRV Buffer; D3D12_TEX2D_SRV Texture2D; }; };
+enum D3D12_UAV_DIMENSION { D3D12_UAV_DIMENSION_BUFFER = 1, D3D12_UAV_DIMENSION_TEXTURE2D = 4 };
+struct D3D12_TEX2D_UAV { UINT MipSlice, PlaneSlice; };
+struct D3D12_BUFFER_UAV { UINT64 FirstElement; UINT NumElements; UINT StructureByteStride; UINT64 CounterOffsetInBytes; UINT Flags; };
+struct D3D12_UNORDERED_ACCESS_VIEW_DESC { DXGI_FORMAT Format; D3D12_UAV_DIMENSION ViewDimension; union { D3D12_BUFFER_UAV Buffer; D3D12_TEX2D_UAV Texture2D; }; };
+enum D3D12_RTV_DIMENSION { D3D12_RTV_DIMENSION_TEXTURE2D = 4 };
+struct D3D12_TEX2D_RTV { UINT MipSlice, PlaneSlice; };
+struct D3D12_RENDER_TARGET_VIEW_DESC { DXGI_FORMAT Format; D3D12_RTV_DIMENSION ViewDimension; union { D3D12_TEX2D_RTV Texture2D; }; };
+enum D3D12_DSV_DIMENSION { D3D12_DSV_DIMENSION_TEXTURE2D = 3 };
+enum D3D12_DSV_FLAGS { D3D12_DSV_FLAG_NONE = 0 };
+struct D3D12_TEX2D_DSV { UINT MipSlice; };
+struct D3D12_DEPTH_STENCIL_VIEW_DESC { DXGI_FORMAT Format; D3D12_DSV_DIMENSION ViewDimension; D3D12_DSV_FLAGS Flags; union { D3D12_TEX2D_DSV Texture2D; }; };
+enum D3D12_CLEAR_FLAGS { D3D12_CLEAR_FLAG_DEPTH = 1, D3D12_CLEAR_FLAG_STENCIL = 2 };
+struct D3D12_DEPTH_STENCIL_VALUE { FLOAT Depth; UINT8 Stencil; };
+struct D3D12_CLEAR_VALUE { DXGI_FORMAT Format; union { FLOAT Color[4]; D3D12_DEPTH_STENCIL_VALUE DepthStencil; }; };
+struct D3D12_CONSTANT_BUFFER_VIEW_DESC { D3D12_GPU_VIRTUAL_ADDRESS BufferLocation; UINT SizeInBytes; };
+struct D3D12_VERTEX_BUFFER_VIEW { D3D12_GPU_VIRTUAL_ADDRESS BufferLocation; UINT SizeInBytes; UINT StrideInBytes; };
+struct D3D12_INDEX_BUFFER_VIEW { D3D12_GPU_VIRTUAL_ADDRESS BufferLocation; UINT SizeInBytes; DXGI_FORMAT Format; };
+struct D3D12_VIEWPORT { FLOAT TopLeftX, TopLeftY, Width, Height, MinDepth, MaxDepth; };
+typedef RECT D3D12_RECT;
+enum D3D12_FENCE_FLAGS { D3D12_FENCE_FLAG_NONE = 0 };
+enum D3D12_DESCRIPTOR_RANGE_TYPE { D3D12_DESCRIPTOR_RANGE_TYPE_SRV, D3D12_DESCRIPTOR_RANGE_TYPE_UAV, D3D12_DESCRIPTOR_RANGE_TYPE_CBV, D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER };
+struct D3D12_DESCRIPTOR_RANGE { D3D12_DESCRIPTOR_RANGE_TYPE RangeType; UINT NumDescriptors; UINT BaseShaderRegister; UINT RegisterSpace; UINT OffsetInDescriptorsFromTableStart; };
+struct D3D12_ROOT_DESCRIPTOR_TABLE { UINT NumDescriptorRanges; const D3D12_DESCRIPTOR_RANGE *pDescriptorRanges; };
+struct D3D12_ROOT_CONSTANTS { UINT ShaderRegister; UINT RegisterSpace; UINT Num32BitValues; };
+struct D3D12_ROOT_DESCRIPTOR { UINT ShaderRegister; UINT RegisterSpace; };
+enum D3D12_ROOT_PARAMETER_TYPE { D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS, D3D12_ROOT_PARAMETER_TYPE_CBV, D3D12_ROOT_PARAMETER_TYPE_SRV, D3D12_ROOT_PARAMETER_TYPE_UAV };
+enum D3D12_SHADER_VISIBILITY { D3D12_SHADER_VISIBILITY_ALL = 0, D3D12_SHADER_VISIBILITY_VERTEX = 1, D3D12_SHADER_VISIBILITY_PIXEL = 5 };
+struct D3D12_ROOT_PARAMETER { D3D12_ROOT_PARAMETER_TYPE ParameterType; union { D3D12_ROOT_DESCRIPTOR_TABLE DescriptorTable; D3D12_ROOT_CONSTANTS Constants; D3D12_ROOT_DESCRIPTOR Descriptor; }; D3D12_SHADER_VISIBILITY ShaderVisibility; };
+enum D3D12_FILTER { D3D12_FILTER_MIN_MAG_MIP_POINT = 0, D3D12_FILTER_MIN_MAG_MIP_LINEAR = 0x15 };
+enum D3D12_TEXTURE_ADDRESS_MODE { D3D12_TEXTURE_ADDRESS_MODE_WRAP = 1, D3D12_TEXTURE_ADDRESS_MODE_CLAMP = 3 };
+enum D3D12_COMPARISON_FUNC { D3D12_COMPARISON_FUNC_NEVER = 1, D3D12_COMPARISON_FUNC_LESS = 2, D3D12_COMPARISON_FUNC_EQUAL = 3, D3D12_COMPARISON_FUNC_LESS_EQUAL = 4, D3D12_COMPARISON_FUNC_ALWAYS = 8 };
+enum D3D12_STATIC_BORDER_COLOR { D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK };
+struct D3D12_STATIC_SAMPLER_DESC { D3D12_FILTER Filter; D3D12_TEXTURE_ADDRESS_MODE AddressU, AddressV, AddressW; FLOAT MipLODBias; UINT MaxAnisotropy; D3D12_COMPARISON_FUNC ComparisonFunc; D3D12_STATIC_BORDER_COLOR BorderColor; FLOAT MinLOD, MaxLOD; UINT ShaderRegister, RegisterSpace; D3D12_SHADER_VISIBILITY ShaderVisibility; };
+enum D3D12_ROOT_SIGNATURE_FLAGS { D3D12_ROOT_SIGNATURE_FLAG_NONE = 0, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT = 1 };
+struct D3D12_ROOT_SIGNATURE_DESC { UINT NumParameters; const D3D12_ROOT_PARAMETER *pParameters; UINT NumStaticSamplers; const D3D12_STATIC_SAMPLER_DESC *pStaticSamplers; D3D12_ROOT_SIGNATURE_FLAGS Flags; };
+struct D3D12_SHADER_BYTECODE { const void *pShaderBytecode; SIZE_T BytecodeLength; };
+enum D3D12_INPUT_CLASSIFICATION { D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA };
+struct D3D12_INPUT_ELEMENT_DESC { LPCSTR SemanticName; UINT SemanticIndex; DXGI_FORMAT Format; UINT InputSlot; UINT AlignedByteOffset; D3D12_INPUT_CLASSIFICATION InputSlotClass; UINT InstanceDataStepRate; };
+struct D3D12_INPUT_LAYOUT_DESC { const D3D12_INPUT_ELEMENT_DESC *pInputElementDescs; UINT NumElements; };
+enum D3D12_BLEND { D3D12_BLEND_ZERO = 1, D3D12_BLEND_ONE = 2, D3D12_BLEND_SRC_ALPHA = 5, D3D12_BLEND_INV_DEST_ALPHA = 8 };
+enum D3D12_BLEND_OP { D3D12_BLEND_OP_ADD = 1 };
+enum D3D12_LOGIC_OP { D3D12_LOGIC_OP_XOR = 6 };
+enum D3D12_COLOR_WRITE_ENABLE { D3D12_COLOR_WRITE_ENABLE_ALL = 15 };
+struct D3D12_RENDER_TARGET_BLEND_DESC { BOOL BlendEnable, LogicOpEnable; D3D12_BLEND SrcBlend, DestBlend; D3D12_BLEND_OP BlendOp; D3D12_BLEND SrcBlendAlpha, DestBlendAlpha; D3D12_BLEND_OP BlendOpAlpha; D3D12_LOGIC_OP LogicOp; UINT8 RenderTargetWriteMask; };
+struct D3D12_BLEND_DESC { BOOL AlphaToCoverageEnable, IndependentBlendEnable; D3D12_RENDER_TARGET_BLEND_DESC RenderTarget[8]; };
+enum D3D12_FILL_MODE { D3D12_FILL_MODE_SOLID = 3 };
+enum D3D12_CULL_MODE { D3D12_CULL_MODE_NONE = 1 };
+struct D3D12_RASTERIZER_DESC { D3D12_FILL_MODE FillMode; D3D12_CULL_MODE CullMode; BOOL FrontCounterClockwise; INT DepthBias; FLOAT DepthBiasClamp, SlopeScaledDepthBias; BOOL DepthClipEnable, MultisampleEnable, AntialiasedLineEnable; UINT ForcedSampleCount; int ConservativeRaster; };
+enum D3D12_DEPTH_WRITE_MASK { D3D12_DEPTH_WRITE_MASK_ZERO = 0, D3D12_DEPTH_WRITE_MASK_ALL = 1 };
+enum D3D12_STENCIL_OP { D3D12_STENCIL_OP_KEEP = 1 };
+struct D3D12_DEPTH_STENCILOP_DESC { D3D12_STENCIL_OP StencilFailOp, StencilDepthFailOp, StencilPassOp; D3D12_COMPARISON_FUNC StencilFunc; };
+struct D3D12_DEPTH_STENCIL_DESC { BOOL DepthEnable; D3D12_DEPTH_WRITE_MASK DepthWriteMask; D3D12_COMPARISON_FUNC DepthFunc; BOOL StencilEnable; UINT8 StencilReadMask, StencilWriteMask; D3D12_DEPTH_STENCILOP_DESC FrontFace, BackFace; };
+enum D3D12_PRIMITIVE_TOPOLOGY_TYPE { D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE = 3 };
+struct ID3D12RootSignature;
+struct D3D12_GRAPHICS_PIPELINE_STATE_DESC { ID3D12RootSignature *pRootSignature; D3D12_SHADER_BYTECODE VS, PS, DS, HS, GS; int StreamOutput[10]; D3D12_BLEND_DESC BlendState; UINT SampleMask; D3D12_RASTERIZER_DESC RasterizerState; D3D12_DEPTH_STENCIL_DESC DepthStencilState; D3D12_INPUT_LAYOUT_DESC InputLayout; int IBStripCutValue; D3D12_PRIMITIVE_TOPOLOGY_TYPE PrimitiveTopologyType; UINT NumRenderTargets; DXGI_FORMAT RTVFormats[8]; DXGI_FORMAT DSVFormat; DXGI_SAMPLE_DESC SampleDesc; UINT NodeMask; int CachedPSO[2]; int Flags; };
+struct D3D12_COMPUTE_PIPELINE_STATE_DESC { ID3D12RootSignature *pRootSignature; D3D12_SHADER_BYTECODE CS; UINT NodeMask; int CachedPSO[2]; int Flags; };
+enum D3D12_INDIRECT_ARGUMENT_TYPE { D3D12_INDIRECT_ARGUMENT_TYPE_DRAW = 0, D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED = 1, D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH = 2 };
+struct D3D12_INDIRECT_ARGUMENT_VERTEX_BUFFER { UINT Slot; };
+struct D3D12_INDIRECT_ARGUMENT_DESC { D3D12_INDIRECT_ARGUMENT_TYPE Type; union { D3D12_INDIRECT_ARGUMENT_VERTEX_BUFFER VertexBuffer; }; };
+struct D3D12_COMMAND_SIGNATURE_DESC { UINT ByteStride; UINT NumArgumentDescs; const D3D12_INDIRECT_ARGUMENT_DESC *pArgumentDescs; UINT NodeMask; };
+struct D3D12_DRAW_INDEXED_ARGUMENTS { UINT IndexCountPerInstance, InstanceCount, StartIndexLocation; INT BaseVertexLocation; UINT StartInstanceLocation; };
+struct D3D12_DISPATCH_ARGUMENTS { UINT ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ; };
+struct ID3D12Object : IUnknown {};
+struct ID3D12Pageable : ID3D12Object {};
+struct ID3D12Heap : ID3D12Pageable { virtual D3D12_HEAP_DESC GetDesc() = 0; };
+struct ID3D12Resource : ID3D12Pageable { virtual HRESULT Map(UINT, const D3D12_RANGE *, void **) = 0; virtual void Unmap(UINT, const D3D12_RANGE *) = 0; virtual D3D12_RESOURCE_DESC GetDesc() = 0; virtual D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() = 0; };
+struct ID3D12CommandAllocator : ID3D12Pageable { virtual HRESULT Reset() = 0; };
+struct ID3D12Fence : ID3D12Pageable { virtual UINT64 GetCompletedValue() = 0; virtual HRESULT SetEventOnCompletion(UINT64, HANDLE) = 0; virtual HRESULT Signal(UINT64) = 0; };
+struct ID3D12PipelineState : ID3D12Pageable {};
+struct ID3D12RootSignature : ID3D12Pageable {};
+struct ID3D12CommandSignature : ID3D12Pageable {};
+struct ID3D12DescriptorHeap : ID3D12Pageable { virtual D3D12_DESCRIPTOR_HEAP_DESC GetDesc() = 0; virtual D3D12_CPU_DESCRIPTOR_HANDLE GetCPUDescriptorHandleForHeapStart() = 0; virtual D3D12_GPU_DESCRIPTOR_HANDLE GetGPUDescriptorHandleForHeapStart() = 0; };
+struct ID3D12CommandList : ID3D12Object { virtual D3D12_COMMAND_LIST_TYPE GetType() = 0; };
+struct ID3D12GraphicsCommandList : ID3D12CommandList {
+	virtual HRESULT Close() = 0; virtual HRESULT Reset(ID3D12CommandAllocator *, ID3D12PipelineState *) = 0;
+	virtual void DrawInstanced(UINT, UINT, UINT, UINT) = 0; virtual void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT) = 0; virtual void Dispatch(UINT, UINT, UINT) = 0;
+	virtual void CopyBufferRegion(ID3D12Resource *, UINT64, ID3D12Resource *, UINT64, UINT64) = 0;
+	virtual void CopyTextureRegion(const D3D12_TEXTURE_COPY_LOCATION *, UINT, UINT, UINT, const D3D12_TEXTURE_COPY_LOCATION *, const D3D12_BOX *) = 0;
+	virtual void IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY) = 0; virtual void RSSetViewports(UINT, const D3D12_VIEWPORT *) = 0; virtual void RSSetScissorRects(UINT, const D3D12_RECT *) = 0;
+	virtual void SetPipelineState(ID3D12PipelineState *) = 0; virtual void ResourceBarrier(UINT, const D3D12_RESOURCE_BARRIER *) = 0;
+	virtual void ExecuteBundle(ID3D12GraphicsCommandList *) = 0; virtual void SetDescriptorHeaps(UINT, ID3D12DescriptorHeap *const *) = 0;
+	virtual void SetComputeRootSignature(ID3D12RootSignature *) = 0; virtual void SetGraphicsRootSignature(ID3D12RootSignature *) = 0;
+	virtual void SetComputeRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) = 0; virtual void SetGraphicsRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) = 0;
+	virtual void SetComputeRoot32BitConstants(UINT, UINT, const void *, UINT) = 0; virtual void SetGraphicsRoot32BitConstants(UINT, UINT, const void *, UINT) = 0;
+	virtual void SetComputeRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) = 0; virtual void SetGraphicsRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) = 0;
+	virtual void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW *) = 0; virtual void IASetVertexBuffers(UINT, UINT, const D3D12_VERTEX_BUFFER_VIEW *) = 0;
+	virtual void OMSetRenderTargets(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE *, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE *) = 0;
+	virtual void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT *) = 0;
+	virtual void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, const FLOAT[4], UINT, const D3D12_RECT *) = 0;
+	virtual void ExecuteIndirect(ID3D12CommandSignature *, UINT, ID3D12Resource *, UINT64, ID3D12Resource *, UINT64) = 0;
+};
+struct ID3D12CommandQueue : ID3D12Pageable { virtual void ExecuteCommandLists(UINT, ID3D12CommandList *const *) = 0; virtual HRESULT Signal(ID3D12Fence *, UINT64) = 0; virtual HRESULT Wait(ID3D12Fence *, UINT64) = 0; };
+struct ID3D12Device : ID3D12Object {
+	virtual HRESULT CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC *, const void *, void **) = 0;
+	virtual HRESULT CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE, const void *, void **) = 0;
+	virtual HRESULT CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC *, const void *, void **) = 0;
+	virtual HRESULT CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC *, const void *, void **) = 0;
+	virtual HRESULT CreateCommandList(UINT, D3D12_COMMAND_LIST_TYPE, ID3D12CommandAllocator *, ID3D12PipelineState *, const void *, void **) = 0;
+	virtual HRESULT CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC *, const void *, void **) = 0;
+	virtual UINT GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE) = 0;
+	virtual HRESULT CreateRootSignature(UINT, const void *, SIZE_T, const void *, void **) = 0;
+	virtual void CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) = 0;
+	virtual void CreateShaderResourceView(ID3D12Resource *, const D3D12_SHADER_RESOURCE_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) = 0;
+	virtual void CreateUnorderedAccessView(ID3D12Resource *, ID3D12Resource *, const D3D12_UNORDERED_ACCESS_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) = 0;
+	virtual void CreateRenderTargetView(ID3D12Resource *, const D3D12_RENDER_TARGET_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) = 0;
+	virtual void CreateDepthStencilView(ID3D12Resource *, const D3D12_DEPTH_STENCIL_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) = 0;
+	virtual HRESULT GetDeviceRemovedReason() = 0;
+	virtual D3D12_RESOURCE_ALLOCATION_INFO GetResourceAllocationInfo(UINT, UINT, const D3D12_RESOURCE_DESC *) = 0;
+	virtual HRESULT CreateCommittedResource(const D3D12_HEAP_PROPERTIES *, D3D12_HEAP_FLAGS, const D3D12_RESOURCE_DESC *, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE *, const void *, void **) = 0;
+	virtual HRESULT CreateHeap(const D3D12_HEAP_DESC *, const void *, void **) = 0;
+	virtual HRESULT CreatePlacedResource(ID3D12Heap *, UINT64, const D3D12_RESOURCE_DESC *, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE *, const void *, void **) = 0;
+	virtual HRESULT CreateFence(UINT64, D3D12_FENCE_FLAGS, const void *, void **) = 0;
+	virtual void GetCopyableFootprints(const D3D12_RESOURCE_DESC *, UINT, UINT, UINT64, D3D12_PLACED_SUBRESOURCE_FOOTPRINT *, UINT *, UINT64 *, UINT64 *) = 0;
+	virtual HRESULT CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC *, ID3D12RootSignature *, const void *, void **) = 0;
+};
+HRESULT D3D12CreateDevice(IUnknown *, D3D_FEATURE_LEVEL, const void *, void **);
+HRESULT D3D12SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC *, D3D_ROOT_SIGNATURE_VERSION, ID3DBlob **, ID3DBlob **);
@@ -0,0 +1,7 @@
+#pragma once
+//Stub of the D3DCompiler declarations gcmd.cpp uses, implemented by stubdevice.cpp.
+#include "d3d12.h"
+struct ID3DInclude;
+struct D3D_SHADER_MACRO { LPCSTR Name; LPCSTR Definition; };
+#define D3D_COMPILE_STANDARD_FILE_INCLUDE ((ID3DInclude *)(uintptr_t)1)
+HRESULT D3DCompileFromFile(LPCWSTR, const void *, ID3DInclude *, LPCSTR, LPCSTR, UINT, UINT, ID3DBlob **, ID3DBlob **);
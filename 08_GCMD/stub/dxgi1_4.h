@@ -0,0 +1,19 @@
+#pragma once
+//Stub of the DXGI declarations gcmd.cpp uses, implemented by stubdevice.cpp.
+#include "d3d12.h"
+struct DXGI_RATIONAL { UINT n, d; };
+enum DXGI_MODE_SCANLINE_ORDER { DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED };
+enum DXGI_MODE_SCALING { DXGI_MODE_SCALING_UNSPECIFIED };
+struct DXGI_MODE_DESC { UINT Width, Height; DXGI_RATIONAL RefreshRate; DXGI_FORMAT Format; DXGI_MODE_SCANLINE_ORDER ScanlineOrdering; DXGI_MODE_SCALING Scaling; };
+typedef UINT DXGI_USAGE;
+#define DXGI_USAGE_RENDER_TARGET_OUTPUT 0x20
+#define DXGI_MWA_NO_ALT_ENTER 2
+enum DXGI_SWAP_EFFECT { DXGI_SWAP_EFFECT_FLIP_DISCARD = 4 };
+enum DXGI_SWAP_CHAIN_FLAG { DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT = 64 };
+struct DXGI_SWAP_CHAIN_DESC { DXGI_MODE_DESC BufferDesc; DXGI_SAMPLE_DESC SampleDesc; DXGI_USAGE BufferUsage; UINT BufferCount; HWND OutputWindow; BOOL Windowed; DXGI_SWAP_EFFECT SwapEffect; UINT Flags; };
+struct IDXGISwapChain : IUnknown { virtual HRESULT Present(UINT, UINT) = 0; virtual HRESULT GetBuffer(UINT, const void *, void **) = 0; };
+struct IDXGISwapChain1 : IDXGISwapChain {};
+struct IDXGISwapChain2 : IDXGISwapChain1 { virtual HRESULT SetMaximumFrameLatency(UINT) = 0; virtual HANDLE GetFrameLatencyWaitableObject() = 0; };
+struct IDXGISwapChain3 : IDXGISwapChain2 { virtual UINT GetCurrentBackBufferIndex() = 0; };
+struct IDXGIFactory4 : IUnknown { virtual HRESULT MakeWindowAssociation(HWND, UINT) = 0; virtual HRESULT CreateSwapChain(IUnknown *, DXGI_SWAP_CHAIN_DESC *, IDXGISwapChain **) = 0; };
+HRESULT CreateDXGIFactory1(const void *, void **);
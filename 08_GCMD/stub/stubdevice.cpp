@@ -0,0 +1,463 @@
+#include <windows.h>
+#include <d3d12.h>
+#include <dxgi1_4.h>
+#include <d3dcompiler.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include "stubdevice.h"
+
+//One counter per stub method, registered the first time the method runs.
+struct stubcall {
+	const char *name;
+	std::atomic<uint64_t> count {0};
+	stubcall *next = nullptr;
+
+	stubcall(const char *name) : name(name)
+	{
+		std::lock_guard<std::mutex> lk(GetLock());
+		next = GetHead();
+		GetHead() = this;
+	}
+
+	static stubcall *& GetHead()
+	{
+		static stubcall *head = nullptr;
+		return head;
+	}
+
+	static std::mutex & GetLock()
+	{
+		static std::mutex lock;
+		return lock;
+	}
+};
+
+#define STUB_CALL() \
+	static stubcall stub_call(__FUNCTION__); \
+	stub_call.count.fetch_add(1, std::memory_order_relaxed)
+
+void StubReport()
+{
+	std::vector<stubcall *> vcall;
+	{
+		std::lock_guard<std::mutex> lk(stubcall::GetLock());
+		for(auto x = stubcall::GetHead(); x; x = x->next)
+			vcall.push_back(x);
+	}
+	std::sort(vcall.begin(), vcall.end(), [](stubcall *a, stubcall *b) { return a->count > b->count; });
+	for(auto x : vcall)
+		printf("%s : %-40s %llu\n", __FUNCTION__, x->name, (unsigned long long)x->count.load());
+}
+
+void StubReset()
+{
+	std::lock_guard<std::mutex> lk(stubcall::GetLock());
+	for(auto x = stubcall::GetHead(); x; x = x->next)
+		x->count = 0;
+}
+
+template<class T>
+struct stubobject : T {
+	std::atomic<ULONG> ref {1};
+
+	virtual ~stubobject() {}
+	HRESULT QueryInterface(const void *, void **ppv) override
+	{
+		AddRef();
+		*ppv = this;
+		return S_OK;
+	}
+	ULONG AddRef() override { return ++ref; }
+	ULONG Release() override
+	{
+		auto count = --ref;
+		if(count == 0)
+			delete this;
+		return count;
+	}
+};
+
+template<class T, class U>
+HRESULT StubCreate(U *p, void **ppv)
+{
+	if(ppv == nullptr) {
+		delete p;
+		return E_NOTIMPL;
+	}
+	*ppv = static_cast<T *>(p);
+	return S_OK;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS StubAllocAddress(UINT64 size)
+{
+	static std::atomic<UINT64> next {0x100000000ull};
+	return next.fetch_add((size + 0xffff) & ~0xffffull);
+}
+
+struct stubblob : stubobject<ID3DBlob> {
+	std::vector<uint8_t> data;
+	stubblob(size_t size) : data(size) {}
+	void *GetBufferPointer() override { return data.data(); }
+	SIZE_T GetBufferSize() override { return data.size(); }
+};
+
+struct stubheap : stubobject<ID3D12Heap> {
+	D3D12_HEAP_DESC desc;
+	stubheap(const D3D12_HEAP_DESC & desc) : desc(desc) {}
+	D3D12_HEAP_DESC GetDesc() override { return desc; }
+};
+
+//Buffers get real memory so uploads through Map still write somewhere.
+struct stubresource : stubobject<ID3D12Resource> {
+	D3D12_RESOURCE_DESC desc;
+	std::vector<uint8_t> memory;
+	D3D12_GPU_VIRTUAL_ADDRESS address;
+
+	stubresource(const D3D12_RESOURCE_DESC & desc) : desc(desc)
+	{
+		if(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+			memory.resize(size_t(desc.Width));
+		address = StubAllocAddress(desc.Width * std::max<UINT>(desc.Height, 1));
+	}
+	HRESULT Map(UINT, const D3D12_RANGE *, void **pp) override
+	{
+		STUB_CALL();
+		*pp = memory.empty() ? nullptr : memory.data();
+		return *pp ? S_OK : E_NOTIMPL;
+	}
+	void Unmap(UINT, const D3D12_RANGE *) override { STUB_CALL(); }
+	D3D12_RESOURCE_DESC GetDesc() override { return desc; }
+	D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() override { return address; }
+};
+
+struct stubcmdalloc : stubobject<ID3D12CommandAllocator> {
+	HRESULT Reset() override { STUB_CALL(); return S_OK; }
+};
+
+//The stub queue completes work as soon as it is submitted, so fences are signaled immediately.
+struct stubfence : stubobject<ID3D12Fence> {
+	std::atomic<UINT64> value;
+	stubfence(UINT64 value) : value(value) {}
+	UINT64 GetCompletedValue() override { STUB_CALL(); return value; }
+	HRESULT SetEventOnCompletion(UINT64, HANDLE) override { STUB_CALL(); return S_OK; }
+	HRESULT Signal(UINT64 x) override { STUB_CALL(); value = x; return S_OK; }
+};
+
+struct stubpipelinestate : stubobject<ID3D12PipelineState> {};
+struct stubrootsignature : stubobject<ID3D12RootSignature> {};
+struct stubcommandsignature : stubobject<ID3D12CommandSignature> {};
+
+struct stubdescriptorheap : stubobject<ID3D12DescriptorHeap> {
+	D3D12_DESCRIPTOR_HEAP_DESC desc;
+	D3D12_GPU_VIRTUAL_ADDRESS base;
+	stubdescriptorheap(const D3D12_DESCRIPTOR_HEAP_DESC & desc) : desc(desc), base(StubAllocAddress(desc.NumDescriptors * 64)) {}
+	D3D12_DESCRIPTOR_HEAP_DESC GetDesc() override { return desc; }
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCPUDescriptorHandleForHeapStart() override { return {SIZE_T(base)}; }
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGPUDescriptorHandleForHeapStart() override { return {base}; }
+};
+
+bool & StubIsRecording()
+{
+	static bool is_recording = false;
+	return is_recording;
+}
+
+void StubRecordBarriers(bool enable)
+{
+	StubIsRecording() = enable;
+}
+
+std::vector<std::vector<D3D12_RESOURCE_BARRIER>> & StubBarrierLog()
+{
+	static std::vector<std::vector<D3D12_RESOURCE_BARRIER>> vlog;
+	return vlog;
+}
+
+struct stubcmdlist : stubobject<ID3D12GraphicsCommandList> {
+	D3D12_COMMAND_LIST_TYPE type;
+	std::vector<std::vector<D3D12_RESOURCE_BARRIER>> vbatch; //Recorded since the last Reset.
+	stubcmdlist(D3D12_COMMAND_LIST_TYPE type) : type(type) {}
+	D3D12_COMMAND_LIST_TYPE GetType() override { return type; }
+	HRESULT Close() override { STUB_CALL(); return S_OK; }
+	HRESULT Reset(ID3D12CommandAllocator *, ID3D12PipelineState *) override
+	{
+		STUB_CALL();
+		vbatch.clear();
+		return S_OK;
+	}
+	void DrawInstanced(UINT, UINT, UINT, UINT) override { STUB_CALL(); }
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT) override { STUB_CALL(); }
+	void Dispatch(UINT, UINT, UINT) override { STUB_CALL(); }
+	void CopyBufferRegion(ID3D12Resource *, UINT64, ID3D12Resource *, UINT64, UINT64) override { STUB_CALL(); }
+	void CopyTextureRegion(const D3D12_TEXTURE_COPY_LOCATION *, UINT, UINT, UINT, const D3D12_TEXTURE_COPY_LOCATION *, const D3D12_BOX *) override { STUB_CALL(); }
+	void IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY) override { STUB_CALL(); }
+	void RSSetViewports(UINT, const D3D12_VIEWPORT *) override { STUB_CALL(); }
+	void RSSetScissorRects(UINT, const D3D12_RECT *) override { STUB_CALL(); }
+	void SetPipelineState(ID3D12PipelineState *) override { STUB_CALL(); }
+	void ResourceBarrier(UINT count, const D3D12_RESOURCE_BARRIER *barriers) override
+	{
+		STUB_CALL();
+		if(StubIsRecording())
+			vbatch.emplace_back(barriers, barriers + count);
+	}
+	void ExecuteBundle(ID3D12GraphicsCommandList *) override { STUB_CALL(); }
+	void SetDescriptorHeaps(UINT, ID3D12DescriptorHeap *const *) override { STUB_CALL(); }
+	void SetComputeRootSignature(ID3D12RootSignature *) override { STUB_CALL(); }
+	void SetGraphicsRootSignature(ID3D12RootSignature *) override { STUB_CALL(); }
+	void SetComputeRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void SetGraphicsRootDescriptorTable(UINT, D3D12_GPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void SetComputeRoot32BitConstants(UINT, UINT, const void *, UINT) override { STUB_CALL(); }
+	void SetGraphicsRoot32BitConstants(UINT, UINT, const void *, UINT) override { STUB_CALL(); }
+	void SetComputeRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { STUB_CALL(); }
+	void SetGraphicsRootConstantBufferView(UINT, D3D12_GPU_VIRTUAL_ADDRESS) override { STUB_CALL(); }
+	void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW *) override { STUB_CALL(); }
+	void IASetVertexBuffers(UINT, UINT, const D3D12_VERTEX_BUFFER_VIEW *) override { STUB_CALL(); }
+	void OMSetRenderTargets(UINT, const D3D12_CPU_DESCRIPTOR_HANDLE *, BOOL, const D3D12_CPU_DESCRIPTOR_HANDLE *) override { STUB_CALL(); }
+	void ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_CLEAR_FLAGS, FLOAT, UINT8, UINT, const D3D12_RECT *) override { STUB_CALL(); }
+	void ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE, const FLOAT[4], UINT, const D3D12_RECT *) override { STUB_CALL(); }
+	void ExecuteIndirect(ID3D12CommandSignature *, UINT, ID3D12Resource *, UINT64, ID3D12Resource *, UINT64) override { STUB_CALL(); }
+};
+
+struct stubqueue : stubobject<ID3D12CommandQueue> {
+	void ExecuteCommandLists(UINT count, ID3D12CommandList *const *lists) override
+	{
+		STUB_CALL();
+		if(!StubIsRecording())
+			return;
+		static std::mutex lock;
+		std::lock_guard<std::mutex> lk(lock);
+		for(UINT i = 0 ; i < count; i++) {
+			auto list = static_cast<stubcmdlist *>(static_cast<ID3D12GraphicsCommandList *>(lists[i]));
+			for(auto & x : list->vbatch)
+				StubBarrierLog().push_back(x);
+		}
+	}
+	HRESULT Signal(ID3D12Fence *fence, UINT64 value) override
+	{
+		STUB_CALL();
+		return fence->Signal(value);
+	}
+	HRESULT Wait(ID3D12Fence *, UINT64) override { STUB_CALL(); return S_OK; }
+};
+
+struct stubdevice : stubobject<ID3D12Device> {
+	HRESULT CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12CommandQueue>(new stubqueue(), ppv);
+	}
+	HRESULT CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12CommandAllocator>(new stubcmdalloc(), ppv);
+	}
+	HRESULT CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12PipelineState>(new stubpipelinestate(), ppv);
+	}
+	HRESULT CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12PipelineState>(new stubpipelinestate(), ppv);
+	}
+	HRESULT CreateCommandList(UINT, D3D12_COMMAND_LIST_TYPE type, ID3D12CommandAllocator *, ID3D12PipelineState *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12GraphicsCommandList>(new stubcmdlist(type), ppv);
+	}
+	HRESULT CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC *desc, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12DescriptorHeap>(new stubdescriptorheap(*desc), ppv);
+	}
+	UINT GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE) override { STUB_CALL(); return 32; }
+	HRESULT CreateRootSignature(UINT, const void *, SIZE_T, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12RootSignature>(new stubrootsignature(), ppv);
+	}
+	void CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void CreateShaderResourceView(ID3D12Resource *, const D3D12_SHADER_RESOURCE_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void CreateUnorderedAccessView(ID3D12Resource *, ID3D12Resource *, const D3D12_UNORDERED_ACCESS_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void CreateRenderTargetView(ID3D12Resource *, const D3D12_RENDER_TARGET_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	void CreateDepthStencilView(ID3D12Resource *, const D3D12_DEPTH_STENCIL_VIEW_DESC *, D3D12_CPU_DESCRIPTOR_HANDLE) override { STUB_CALL(); }
+	HRESULT GetDeviceRemovedReason() override { STUB_CALL(); return S_OK; }
+	D3D12_RESOURCE_ALLOCATION_INFO GetResourceAllocationInfo(UINT, UINT, const D3D12_RESOURCE_DESC *desc) override
+	{
+		STUB_CALL();
+		UINT64 size = desc->Width * std::max<UINT>(desc->Height, 1);
+		if(desc->Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+			size *= 4;
+		return {(size + 0xffff) & ~0xffffull, 0x10000};
+	}
+	HRESULT CreateCommittedResource(const D3D12_HEAP_PROPERTIES *, D3D12_HEAP_FLAGS, const D3D12_RESOURCE_DESC *desc, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12Resource>(new stubresource(*desc), ppv);
+	}
+	HRESULT CreateHeap(const D3D12_HEAP_DESC *desc, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12Heap>(new stubheap(*desc), ppv);
+	}
+	HRESULT CreatePlacedResource(ID3D12Heap *, UINT64, const D3D12_RESOURCE_DESC *desc, D3D12_RESOURCE_STATES, const D3D12_CLEAR_VALUE *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12Resource>(new stubresource(*desc), ppv);
+	}
+	HRESULT CreateFence(UINT64 value, D3D12_FENCE_FLAGS, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12Fence>(new stubfence(value), ppv);
+	}
+	void GetCopyableFootprints(const D3D12_RESOURCE_DESC *desc, UINT, UINT, UINT64, D3D12_PLACED_SUBRESOURCE_FOOTPRINT *footprint, UINT *rows, UINT64 *row_size, UINT64 *total) override
+	{
+		STUB_CALL();
+		UINT pitch = (UINT(desc->Width) * 4 + 255) & ~255u;
+		if(footprint)
+			*footprint = {0, {desc->Format, UINT(desc->Width), desc->Height, 1, pitch}};
+		if(rows)
+			*rows = desc->Height;
+		if(row_size)
+			*row_size = desc->Width * 4;
+		if(total)
+			*total = UINT64(pitch) * desc->Height;
+	}
+	HRESULT CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC *, ID3D12RootSignature *, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		return StubCreate<ID3D12CommandSignature>(new stubcommandsignature(), ppv);
+	}
+};
+
+struct stubswapchain : stubobject<IDXGISwapChain3> {
+	std::vector<ID3D12Resource *> vbuffer;
+	UINT index = 0;
+
+	stubswapchain(const DXGI_SWAP_CHAIN_DESC & desc)
+	{
+		D3D12_RESOURCE_DESC res_desc = {
+			D3D12_RESOURCE_DIMENSION_TEXTURE2D, 0, desc.BufferDesc.Width, desc.BufferDesc.Height, 1, 1,
+			desc.BufferDesc.Format, {1, 0}, D3D12_TEXTURE_LAYOUT_UNKNOWN, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+		};
+		for(UINT i = 0 ; i < desc.BufferCount; i++)
+			vbuffer.push_back(new stubresource(res_desc));
+	}
+	~stubswapchain()
+	{
+		for(auto x : vbuffer)
+			x->Release();
+	}
+	HRESULT Present(UINT, UINT) override
+	{
+		STUB_CALL();
+		index = (index + 1) % vbuffer.size();
+		return S_OK;
+	}
+	HRESULT GetBuffer(UINT i, const void *, void **ppv) override
+	{
+		STUB_CALL();
+		vbuffer[i]->AddRef();
+		*ppv = vbuffer[i];
+		return S_OK;
+	}
+	HRESULT SetMaximumFrameLatency(UINT) override { STUB_CALL(); return S_OK; }
+	HANDLE GetFrameLatencyWaitableObject() override { STUB_CALL(); return CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS); }
+	UINT GetCurrentBackBufferIndex() override { return index; }
+};
+
+struct stubfactory : stubobject<IDXGIFactory4> {
+	HRESULT MakeWindowAssociation(HWND, UINT) override { STUB_CALL(); return S_OK; }
+	HRESULT CreateSwapChain(IUnknown *, DXGI_SWAP_CHAIN_DESC *desc, IDXGISwapChain **pp) override
+	{
+		STUB_CALL();
+		*pp = new stubswapchain(*desc);
+		return S_OK;
+	}
+};
+
+HRESULT D3D12CreateDevice(IUnknown *, D3D_FEATURE_LEVEL, const void *, void **ppv)
+{
+	STUB_CALL();
+	return StubCreate<ID3D12Device>(new stubdevice(), ppv);
+}
+
+HRESULT D3D12SerializeRootSignature(const D3D12_ROOT_SIGNATURE_DESC *, D3D_ROOT_SIGNATURE_VERSION, ID3DBlob **blob, ID3DBlob **err)
+{
+	STUB_CALL();
+	*blob = new stubblob(16);
+	if(err)
+		*err = nullptr;
+	return S_OK;
+}
+
+HRESULT CreateDXGIFactory1(const void *, void **ppv)
+{
+	STUB_CALL();
+	return StubCreate<IDXGIFactory4>(new stubfactory(), ppv);
+}
+
+//Shaders always compile, so replays do not depend on the hlsl files.
+HRESULT D3DCompileFromFile(LPCWSTR, const void *, ID3DInclude *, LPCSTR, LPCSTR, UINT, UINT, ID3DBlob **blob, ID3DBlob **err)
+{
+	STUB_CALL();
+	*blob = new stubblob(16);
+	if(err)
+		*err = nullptr;
+	return S_OK;
+}
+
+HANDLE CreateEventEx(void *, LPCSTR, DWORD, DWORD)
+{
+	STUB_CALL();
+	return new int(0);
+}
+
+HANDLE CreateEvent(void *, BOOL, BOOL, LPCSTR)
+{
+	STUB_CALL();
+	return new int(0);
+}
+
+DWORD WaitForSingleObject(HANDLE, DWORD)
+{
+	STUB_CALL();
+	return WAIT_OBJECT_0;
+}
+
+DWORD WaitForSingleObjectEx(HANDLE, DWORD, BOOL)
+{
+	STUB_CALL();
+	return WAIT_OBJECT_0;
+}
+
+BOOL CloseHandle(HANDLE h)
+{
+	STUB_CALL();
+	delete (int *)h;
+	return TRUE;
+}
+
+void Sleep(DWORD ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count)
+{
+	count->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *freq)
+{
+	freq->QuadPart = 1000000000;
+	return TRUE;
+}
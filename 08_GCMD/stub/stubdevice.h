@@ -0,0 +1,13 @@
+#pragma once
+//The stub device counts every API call instead of doing any work.
+#include <d3d12.h>
+#include <vector>
+
+//Prints how many times each stub method was called, most frequent first.
+void StubReport();
+void StubReset();
+
+//With recording on, every ResourceBarrier call of a stub command list is kept as one batch, and the
+//batches are appended to the log in the order the queues execute the lists.
+void StubRecordBarriers(bool enable);
+std::vector<std::vector<D3D12_RESOURCE_BARRIER>> & StubBarrierLog();
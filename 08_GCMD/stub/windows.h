@@ -0,0 +1,70 @@
+#pragma once
+//Stub of the Win32 declarations gcmd.cpp uses. Together with d3d12.h, dxgi1_4.h, d3dcompiler.h
+//and stubdevice.cpp it lets the translation layer build and run without Windows or a GPU.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+typedef int BOOL; typedef unsigned int UINT; typedef int INT; typedef unsigned char UINT8; typedef uint16_t UINT16;
+typedef uint64_t UINT64; typedef uint32_t DWORD; typedef float FLOAT; typedef long HRESULT; typedef long LONG; typedef unsigned long ULONG;
+typedef int64_t LONGLONG; typedef uint64_t SIZE_T; typedef wchar_t WCHAR; typedef const wchar_t *LPCWSTR; typedef const char *LPCSTR; typedef void *LPVOID;
+typedef void *HANDLE; typedef struct HWND__ *HWND; typedef void *HINSTANCE; typedef void *HICON; typedef void *HCURSOR; typedef void *HBRUSH; typedef void *HMODULE;
+typedef intptr_t LPARAM; typedef uintptr_t WPARAM; typedef intptr_t LRESULT; typedef uint8_t BYTE;
+typedef union { struct { DWORD LowPart; LONG HighPart; } u; LONGLONG QuadPart; } LARGE_INTEGER;
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define INFINITE 0xFFFFFFFF
+#define EVENT_ALL_ACCESS 0x1F0003
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define S_OK 0
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define FAILED(hr) ((hr) < 0)
+#define SUCCEEDED(hr) ((hr) >= 0)
+#define _countof(a) (sizeof(a)/sizeof((a)[0]))
+#define VK_ESCAPE 0x1B
+#define VK_F5 0x74
+typedef struct { LONG left, top, right, bottom; } RECT;
+typedef struct { HWND hwnd; UINT message; WPARAM wParam; LPARAM lParam; } MSG;
+typedef LRESULT (*WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+typedef struct { UINT cbSize, style; WNDPROC lpfnWndProc; int a, b; HINSTANCE h; HICON i; HCURSOR c; HBRUSH br; LPCSTR m; LPCSTR n; HICON s; } WNDCLASSEX;
+typedef struct { int dummy; } SECURITY_ATTRIBUTES;
+#define WM_SYSCOMMAND 1
+#define SC_MONITORPOWER 2
+#define SC_SCREENSAVE 3
+#define WM_CLOSE 4
+#define WM_DESTROY 5
+#define WM_IME_SETCONTEXT 6
+#define ISC_SHOWUIALL 7
+#define WM_KEYDOWN 8
+#define WM_QUIT 9
+#define PM_REMOVE 1
+#define WS_OVERLAPPEDWINDOW 1
+#define WS_MAXIMIZEBOX 2
+#define WS_THICKFRAME 4
+#define WS_EX_APPWINDOW 1
+#define WS_EX_WINDOWEDGE 2
+#define CS_CLASSDC 1
+#define IDI_APPLICATION 0
+#define IDC_ARROW 0
+#define BLACK_BRUSH 0
+#define SM_CXSCREEN 0
+#define SM_CYSCREEN 1
+#define SW_SHOW 1
+HMODULE GetModuleHandle(LPCSTR);
+HICON LoadIcon(HINSTANCE, int); HCURSOR LoadCursor(HINSTANCE, int); void *GetStockObject(int);
+int RegisterClassEx(const WNDCLASSEX *); BOOL AdjustWindowRectEx(RECT *, DWORD, BOOL, DWORD);
+HWND CreateWindowEx(DWORD, LPCSTR, LPCSTR, DWORD, int, int, int, int, HWND, void *, HINSTANCE, void *);
+int GetSystemMetrics(int); BOOL ShowWindow(HWND, int); HWND SetFocus(HWND);
+BOOL PeekMessage(MSG *, HWND, UINT, UINT, UINT); BOOL TranslateMessage(const MSG *); LRESULT DispatchMessage(const MSG *);
+void PostQuitMessage(int); LRESULT DefWindowProc(HWND, UINT, WPARAM, LPARAM);
+short GetAsyncKeyState(int);
+HANDLE CreateEventEx(void *, LPCSTR, DWORD, DWORD); HANDLE CreateEvent(void *, BOOL, BOOL, LPCSTR);
+DWORD WaitForSingleObject(HANDLE, DWORD); DWORD WaitForSingleObjectEx(HANDLE, DWORD, BOOL); BOOL CloseHandle(HANDLE); void Sleep(DWORD);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *); BOOL QueryPerformanceFrequency(LARGE_INTEGER *);
+struct IUnknown { virtual HRESULT QueryInterface(const void *, void **) = 0; virtual ULONG AddRef() = 0; virtual ULONG Release() = 0; };
+template<class T> inline const void *__uuidof_stub(T **) { return nullptr; }
+#define IID_PPV_ARGS(pp) __uuidof_stub(pp), reinterpret_cast<void **>(pp)